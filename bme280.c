@@ -24,6 +24,7 @@
 #endif  //  __NuttX__
 
 #include "bme280.h"
+#include "compensate.h"
 
 #ifdef __NuttX__
 #define NL "\n"  //  NuttX requires newline when logging
@@ -31,6 +32,16 @@
 #define NL       //  Zephyr doesn't need newline
 #endif  //  __NuttX__
 
+/*
+ * The NuttX register accessors update the device (statistics, trace and
+ * I2C frequency fallback), so the device is not const there.
+ */
+#ifdef __NuttX__
+typedef struct device bme280_dev_t;
+#else
+typedef const struct device bme280_dev_t;
+#endif  //  __NuttX__
+
 #ifndef __NuttX__
 LOG_MODULE_REGISTER(BME280, CONFIG_SENSOR_LOG_LEVEL);
 #endif  //  !__NuttX__
@@ -42,25 +53,20 @@ LOG_MODULE_REGISTER(BME280, CONFIG_SENSOR_LOG_LEVEL);
 #endif  //  !__NuttX__
 
 struct bme280_data {
-	/* Compensation parameters. */
-	uint16_t dig_t1;
-	int16_t dig_t2;
-	int16_t dig_t3;
-	uint16_t dig_p1;
-	int16_t dig_p2;
-	int16_t dig_p3;
-	int16_t dig_p4;
-	int16_t dig_p5;
-	int16_t dig_p6;
-	int16_t dig_p7;
-	int16_t dig_p8;
-	int16_t dig_p9;
-	uint8_t dig_h1;
-	int16_t dig_h2;
-	uint8_t dig_h3;
-	int16_t dig_h4;
-	int16_t dig_h5;
-	int8_t dig_h6;
+	/* Calibration NVM as read from the chip. */
+	uint8_t nvm[BME280_NVM_SIZE];
+
+	/* Compensation parameters as used by the compensation code. */
+	struct bme280_coeffs coeffs;
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+	struct bme280_fcoeffs fcoeffs;
+
+	/* Compensated values in DegC, Pa and %RH. */
+	float temperature;
+	float pressure;
+	float humidity;
+	float ft_fine;
+#endif
 
 	/* Compensated values. */
 	int32_t comp_temp;
@@ -70,9 +76,48 @@ struct bme280_data {
 	/* Carryover between temperature and pressure/humidity compensation. */
 	int32_t t_fine;
 
+	/*
+	 * Terms of the pressure/humidity compensation that depend only on
+	 * t_fine, valid while adc_temp equals memo_adc_temp.
+	 */
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+	struct bme280_fterms terms;
+#else
+	struct bme280_terms terms;
+#endif
+	int32_t memo_adc_temp;
+	bool memo_valid;
+	uint32_t memo_hits;
+	uint32_t memo_misses;
+
 	uint8_t chip_id;
+
+	/* Compensation parameters are valid, chip may resume without init. */
+	bool calibrated;
+
+	/* Uptime (us) when the measurement in progress will be complete. */
+	uint64_t ready_us;
+
+	/* Active control register values, may be changed at runtime. */
+	uint8_t ctrl_hum;
+	uint8_t ctrl_meas;
+	uint8_t config;
+
+	/* Shadow of the control registers as last written to the chip. */
+	uint8_t shadow_ctrl_hum;
+	uint8_t shadow_ctrl_meas;
+	uint8_t shadow_config;
+	bool shadow_valid;
 };
 
+/* Initial value of struct bme280_data: control registers from Kconfig. */
+#define BME280_DATA_INIT					\
+	{							\
+		.ctrl_hum = BME280_HUMIDITY_OVER,		\
+		.ctrl_meas = BME280_CTRL_MEAS_VAL,		\
+		.config = BME280_CONFIG_VAL,			\
+	}
+
 struct bme280_config {
 	union bme280_bus bus;
 	const struct bme280_bus_io *bus_io;
@@ -83,7 +128,7 @@ struct bme280_config {
 #endif  //  __NuttX__
 
 #ifndef __NuttX__
-static inline int bme280_bus_check(const struct device *dev)
+static inline int bme280_bus_check(bme280_dev_t *dev)
 {
 	const struct bme280_config *cfg = dev->config;
 
@@ -92,7 +137,7 @@ static inline int bme280_bus_check(const struct device *dev)
 #endif  //  !__NuttX__
 
 #ifndef __NuttX__
-static inline int bme280_reg_read(const struct device *dev,
+static inline int bme280_reg_read(bme280_dev_t *dev,
 				  uint8_t start, uint8_t *buf, int size)
 {
 	const struct bme280_config *cfg = dev->config;
@@ -102,7 +147,7 @@ static inline int bme280_reg_read(const struct device *dev,
 #endif  //  !__NuttX__
 
 #ifndef __NuttX__
-static inline int bme280_reg_write(const struct device *dev, uint8_t reg,
+static inline int bme280_reg_write(bme280_dev_t *dev, uint8_t reg,
 				   uint8_t val)
 {
 	const struct bme280_config *cfg = dev->config;
@@ -111,96 +156,318 @@ static inline int bme280_reg_write(const struct device *dev, uint8_t reg,
 }
 #endif  //  !__NuttX__
 
+#ifndef __NuttX__
+static int bme280_reg_write_multi(bme280_dev_t *dev,
+				  const uint8_t *pairs, int count)
+{
+	const struct bme280_config *cfg = dev->config;
+	int ret = 0;
+
+	if (cfg->bus_io->write_multi != NULL) {
+		return cfg->bus_io->write_multi(&cfg->bus, pairs, count);
+	}
+
+	for (int i = 0; i < count && ret >= 0; i++) {
+		ret = bme280_reg_write(dev, pairs[2 * i], pairs[2 * i + 1]);
+	}
+
+	return ret;
+}
+#endif  //  !__NuttX__
+
 /*
- * Compensation code taken from BME280 datasheet, Section 4.2.3
- * "Compensation formula".
+ * Compensate the temperature, then the terms of the pressure and humidity
+ * compensation that depend only on t_fine.  At a steady temperature,
+ * adc_temp repeats and the previous results are reused.
  */
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
 static void bme280_compensate_temp(struct bme280_data *data, int32_t adc_temp)
 {
-	int32_t var1, var2;
-
-	var1 = (((adc_temp >> 3) - ((int32_t)data->dig_t1 << 1)) *
-		((int32_t)data->dig_t2)) >> 11;
-	var2 = (((((adc_temp >> 4) - ((int32_t)data->dig_t1)) *
-		  ((adc_temp >> 4) - ((int32_t)data->dig_t1))) >> 12) *
-		((int32_t)data->dig_t3)) >> 14;
+	if (data->memo_valid && adc_temp == data->memo_adc_temp) {
+		data->memo_hits++;
+		return;
+	}
 
-	data->t_fine = var1 + var2;
-	data->comp_temp = (data->t_fine * 5 + 128) >> 8;
+	data->memo_misses++;
+	data->ft_fine = bme280_compf_t_fine(&data->fcoeffs, adc_temp);
+	data->temperature = bme280_compf_temp(data->ft_fine);
+	bme280_compf_press_terms(&data->fcoeffs, data->ft_fine, &data->terms);
+	if (data->chip_id == BME280_CHIP_ID) {
+		bme280_compf_humidity_terms(&data->fcoeffs, data->ft_fine,
+					    &data->terms);
+	}
+	data->memo_adc_temp = adc_temp;
+	data->memo_valid = true;
 }
 
 static void bme280_compensate_press(struct bme280_data *data, int32_t adc_press)
 {
-	int64_t var1, var2, p;
-
-	var1 = ((int64_t)data->t_fine) - 128000;
-	var2 = var1 * var1 * (int64_t)data->dig_p6;
-	var2 = var2 + ((var1 * (int64_t)data->dig_p5) << 17);
-	var2 = var2 + (((int64_t)data->dig_p4) << 35);
-	var1 = ((var1 * var1 * (int64_t)data->dig_p3) >> 8) +
-		((var1 * (int64_t)data->dig_p2) << 12);
-	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)data->dig_p1) >> 33;
-
-	/* Avoid exception caused by division by zero. */
-	if (var1 == 0) {
-		data->comp_press = 0U;
+	data->pressure = bme280_compf_press_apply(&data->fcoeffs, &data->terms,
+						  adc_press);
+}
+
+static void bme280_compensate_humidity(struct bme280_data *data,
+				       int32_t adc_humidity)
+{
+	data->humidity = bme280_compf_humidity_apply(&data->fcoeffs,
+						     &data->terms,
+						     adc_humidity);
+}
+#else
+static void bme280_compensate_temp(struct bme280_data *data, int32_t adc_temp)
+{
+	if (data->memo_valid && adc_temp == data->memo_adc_temp) {
+		data->memo_hits++;
 		return;
 	}
 
-	p = 1048576 - adc_press;
-	p = (((p << 31) - var2) * 3125) / var1;
-	var1 = (((int64_t)data->dig_p9) * (p >> 13) * (p >> 13)) >> 25;
-	var2 = (((int64_t)data->dig_p8) * p) >> 19;
-	p = ((p + var1 + var2) >> 8) + (((int64_t)data->dig_p7) << 4);
+	data->memo_misses++;
+	data->t_fine = bme280_comp_t_fine(&data->coeffs, adc_temp);
+	data->comp_temp = bme280_comp_temp(data->t_fine);
+	bme280_comp_press_terms(&data->coeffs, data->t_fine, &data->terms);
+	if (data->chip_id == BME280_CHIP_ID) {
+		bme280_comp_humidity_terms(&data->coeffs, data->t_fine,
+					   &data->terms);
+	}
+	data->memo_adc_temp = adc_temp;
+	data->memo_valid = true;
+}
 
-	data->comp_press = (uint32_t)p;
+static void bme280_compensate_press(struct bme280_data *data, int32_t adc_press)
+{
+	data->comp_press = bme280_comp_press_apply(&data->coeffs, &data->terms,
+						   adc_press);
 }
 
 static void bme280_compensate_humidity(struct bme280_data *data,
 				       int32_t adc_humidity)
 {
-	int32_t h;
-
-	h = (data->t_fine - ((int32_t)76800));
-	h = ((((adc_humidity << 14) - (((int32_t)data->dig_h4) << 20) -
-		(((int32_t)data->dig_h5) * h)) + ((int32_t)16384)) >> 15) *
-		(((((((h * ((int32_t)data->dig_h6)) >> 10) * (((h *
-		((int32_t)data->dig_h3)) >> 11) + ((int32_t)32768))) >> 10) +
-		((int32_t)2097152)) * ((int32_t)data->dig_h2) + 8192) >> 14);
-	h = (h - (((((h >> 15) * (h >> 15)) >> 7) *
-		((int32_t)data->dig_h1)) >> 4));
-	h = (h > 419430400 ? 419430400 : h);
-
-	data->comp_humidity = (uint32_t)(h >> 12);
+	data->comp_humidity = bme280_comp_humidity_apply(&data->coeffs,
+							 &data->terms,
+							 adc_humidity);
+}
+#endif /* CONFIG_BME280_FLOAT_COMPENSATION */
+
+#ifndef CONFIG_BME280_STATS
+/*
+ * Performance counters are kept by the NuttX driver with
+ * CONFIG_BME280_STATS.  Otherwise the hooks compile to nothing.
+ */
+#define bme280_stats_time() 0
+#define bme280_stats_wait(dev, start, ready, waits) \
+	((void)(start), (void)(ready), (void)(waits))
+#define bme280_stats_compensate(dev, start) ((void)(start))
+#endif
+
+#ifndef CONFIG_BME280_RECORD
+/* Raw frames are recorded by the NuttX driver with CONFIG_BME280_RECORD. */
+#define bme280_record_frame(dev, raw)
+#endif
+
+static inline uint64_t bme280_uptime_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/* Number of conversions for an osrs_x field (0 = skipped). */
+static inline uint32_t bme280_oversampling(uint8_t osrs)
+{
+	return (osrs == 0) ? 0 : (osrs >= 5) ? 16 : (1 << (osrs - 1));
+}
+
+/*
+ * Maximum measurement time in microseconds for the given CTRL_MEAS and
+ * CTRL_HUM values, from the BME280 datasheet, Section 9.1
+ * "Measurement time".
+ */
+static uint32_t bme280_meas_time_us(uint8_t ctrl_meas, uint8_t ctrl_hum)
+{
+	uint32_t osrs_t = bme280_oversampling((ctrl_meas >> 5) & 0x07);
+	uint32_t osrs_p = bme280_oversampling((ctrl_meas >> 2) & 0x07);
+	uint32_t osrs_h = bme280_oversampling(ctrl_hum & 0x07);
+	uint32_t t = 1250 + 2300 * osrs_t;
+
+	if (osrs_p) {
+		t += 2300 * osrs_p + 575;
+	}
+	if (osrs_h) {
+		t += 2300 * osrs_h + 575;
+	}
+
+	return t;
+}
+
+/* Record that a measurement was started by writing CTRL_MEAS. */
+static void bme280_meas_started(struct bme280_data *data)
+{
+	data->ready_us = bme280_uptime_us() +
+		bme280_meas_time_us(data->ctrl_meas, data->ctrl_hum);
+}
+
+/*
+ * Sleep until the measurement in progress is expected to be complete.
+ * Returns true if it slept.
+ */
+static bool bme280_meas_wait(struct bme280_data *data)
+{
+	uint64_t now = bme280_uptime_us();
+
+	if (now < data->ready_us) {
+		k_sleep(K_USEC(data->ready_us - now));
+		return true;
+	}
+
+	return false;
 }
 
-static int bme280_wait_until_ready(const struct device *dev)
+static int bme280_wait_until_ready(bme280_dev_t *dev,
+				   uint32_t delay_us)
 {
 	uint8_t status = 0;
+	uint32_t waited = 0;
+	uint32_t waits = 1;
+	uint64_t start = bme280_stats_time();
+	uint64_t ready;
 	int ret;
 
-	/* Wait for NVM to copy and and measurement to be completed */
-	do {
-		k_sleep(K_MSEC(3));
+	/*
+	 * Sleep for the expected NVM copy or measurement time, then poll
+	 * only if the sensor is late.
+	 */
+	k_sleep(K_USEC(delay_us));
+	while (true) {
+		ready = bme280_stats_time();
 		ret = bme280_reg_read(dev, BME280_REG_STATUS, &status, 1);
 		if (ret < 0) {
 			return ret;
 		}
-	} while (status & (BME280_STATUS_MEASURING | BME280_STATUS_IM_UPDATE));
+		if (!(status & (BME280_STATUS_MEASURING |
+				BME280_STATUS_IM_UPDATE))) {
+			bme280_stats_wait(dev, start, ready, waits);
+			return 0;
+		}
+		if (waited >= BME280_POLL_TIMEOUT_US) {
+			return -ETIMEDOUT;
+		}
+
+		k_sleep(K_USEC(BME280_POLL_US));
+		waited += BME280_POLL_US;
+		waits++;
+	}
+}
+
+#ifdef CONFIG_BME280_VERIFY_CTRL
+/* Read back the control registers and compare with the shadow copy. */
+static int bme280_ctrl_verify(bme280_dev_t *dev)
+{
+	struct bme280_data *data = dev->data;
+	uint8_t buf[4];		/* CTRL_HUM, STATUS, CTRL_MEAS, CONFIG */
+	uint8_t mode_mask = BME280_MODE_MASK;
+	int err;
+
+	err = bme280_reg_read(dev, BME280_REG_CTRL_HUM, buf, sizeof(buf));
+	if (err < 0) {
+		return err;
+	}
+
+	/* Forced mode returns to sleep mode by itself. */
+	if ((data->shadow_ctrl_meas & BME280_MODE_MASK) ==
+	    BME280_MODE_FORCED) {
+		mode_mask = 0;
+	}
+
+	if ((data->chip_id == BME280_CHIP_ID &&
+	     (buf[0] & BME280_OSRS_H_MASK) != data->shadow_ctrl_hum) ||
+	    (buf[2] & (~BME280_MODE_MASK | mode_mask)) !=
+	    (data->shadow_ctrl_meas & (~BME280_MODE_MASK | mode_mask)) ||
+	    (buf[3] & ~0x02) != (data->shadow_config & ~0x02)) {
+		LOG_DBG("CTRL verify failed: %02x %02x %02x" NL,
+			buf[0], buf[2], buf[3]);
+		data->shadow_valid = false;
+		return -EIO;
+	}
 
 	return 0;
 }
+#endif /* CONFIG_BME280_VERIFY_CTRL */
 
-static int bme280_sample_fetch(const struct device *dev,
-			       enum sensor_channel chan)
+/*
+ * Write the control registers that differ from the shadow copy, in one
+ * transfer.  CTRL_MEAS goes last and is also written when CTRL_HUM
+ * changes (CTRL_HUM takes effect on the CTRL_MEAS write) or to trigger
+ * a forced measurement.  Writes to CONFIG may be ignored in normal mode,
+ * so the chip is put to sleep mode before CONFIG changes.
+ */
+static int bme280_ctrl_write(bme280_dev_t *dev, uint8_t ctrl_hum,
+			     uint8_t ctrl_meas, uint8_t config, bool trigger)
 {
 	struct bme280_data *data = dev->data;
-	uint8_t buf[8];
-	int32_t adc_press, adc_temp, adc_humidity;
-	int size = 6;
-	int ret;
+	bool valid = data->shadow_valid;
+	uint8_t pairs[8];
+	int count = 0;
+	int err;
 
-	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
+	if (!valid || config != data->shadow_config) {
+		if (valid && (data->shadow_ctrl_meas & BME280_MODE_MASK) ==
+		    BME280_MODE_NORMAL) {
+			pairs[count++] = BME280_REG_CTRL_MEAS;
+			pairs[count++] = data->shadow_ctrl_meas &
+					 ~BME280_MODE_MASK;
+		}
+		pairs[count++] = BME280_REG_CONFIG;
+		pairs[count++] = config;
+	}
+
+	/* No humidity on BMP280 */
+	if (data->chip_id == BME280_CHIP_ID &&
+	    (!valid || ctrl_hum != data->shadow_ctrl_hum)) {
+		pairs[count++] = BME280_REG_CTRL_HUM;
+		pairs[count++] = ctrl_hum;
+	}
+
+	if (!valid || trigger || count > 0 ||
+	    ctrl_meas != data->shadow_ctrl_meas) {
+		pairs[count++] = BME280_REG_CTRL_MEAS;
+		pairs[count++] = ctrl_meas;
+	}
+
+	if (count == 0) {
+		/* Nothing changed */
+		return 0;
+	}
+
+	err = bme280_reg_write_multi(dev, pairs, count / 2);
+	if (err < 0) {
+		LOG_DBG("CTRL write failed: %d" NL, err);
+		data->shadow_valid = false;
+		return err;
+	}
+
+	data->shadow_ctrl_hum = ctrl_hum;
+	data->shadow_ctrl_meas = ctrl_meas;
+	data->shadow_config = config;
+	data->shadow_valid = true;
+
+	if ((ctrl_meas & BME280_MODE_MASK) != BME280_MODE_SLEEP) {
+		/* The CTRL_MEAS write starts a measurement. */
+		bme280_meas_started(data);
+	}
+
+#ifdef CONFIG_BME280_VERIFY_CTRL
+	return bme280_ctrl_verify(dev);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * First half of a sample fetch: start a measurement in forced mode.  In
+ * normal mode the sensor measures by itself.
+ */
+static int bme280_sample_start(bme280_dev_t *dev)
+{
+	struct bme280_data *data = dev->data;
+	int ret;
 
 #ifdef CONFIG_PM_DEVICE
 	enum pm_device_state state;
@@ -210,41 +477,118 @@ static int bme280_sample_fetch(const struct device *dev,
 		return -EIO;
 #endif
 
-#ifdef CONFIG_BME280_MODE_FORCED
-	ret = bme280_reg_write(dev, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_VAL);
-	if (ret < 0) {
-		return ret;
+	if ((data->ctrl_meas & BME280_MODE_MASK) == BME280_MODE_FORCED) {
+		/* Start a measurement */
+		ret = bme280_ctrl_write(dev, data->ctrl_hum, data->ctrl_meas,
+					data->config, true);
+		if (ret < 0) {
+			return ret;
+		}
 	}
-#endif
 
-	ret = bme280_wait_until_ready(dev);
-	if (ret < 0) {
-		return ret;
-	}
+	return 0;
+}
+
+/*
+ * Read STATUS and the data registers in one burst of BME280_BURST_SIZE
+ * bytes, without waiting for the measurement.  The humidity bytes are
+ * left alone on BMP280.
+ */
+static int bme280_burst_read(bme280_dev_t *dev, uint8_t *buf)
+{
+	struct bme280_data *data = dev->data;
+	int size = BME280_BURST_SIZE - 2;
 
 	if (data->chip_id == BME280_CHIP_ID) {
-		size = 8;
-	}
-	ret = bme280_reg_read(dev, BME280_REG_PRESS_MSB, buf, size);
-	if (ret < 0) {
-		return ret;
+		size = BME280_BURST_SIZE;
 	}
 
-	adc_press = (buf[0] << 12) | (buf[1] << 4) | (buf[2] >> 4);
-	adc_temp = (buf[3] << 12) | (buf[4] << 4) | (buf[5] >> 4);
+	return bme280_reg_read(dev, BME280_REG_STATUS, buf, size);
+}
+
+/* Compensate the data registers of a burst read. */
+static void bme280_burst_compensate(bme280_dev_t *dev, const uint8_t *buf)
+{
+	struct bme280_data *data = dev->data;
+	const uint8_t *raw = &buf[BME280_REG_PRESS_MSB - BME280_REG_STATUS];
+	int32_t adc_press, adc_temp, adc_humidity;
+	uint64_t start;
+
+	bme280_record_frame(dev, raw);
+	bme280_raw_decode(raw, &adc_press, &adc_temp, &adc_humidity);
 
+	start = bme280_stats_time();
 	bme280_compensate_temp(data, adc_temp);
 	bme280_compensate_press(data, adc_press);
 
 	if (data->chip_id == BME280_CHIP_ID) {
-		adc_humidity = (buf[6] << 8) | buf[7];
 		bme280_compensate_humidity(data, adc_humidity);
 	}
+	bme280_stats_compensate(dev, start);
+}
+
+/*
+ * Second half of a sample fetch: wait for the measurement, read it and
+ * compensate it.
+ */
+static int bme280_sample_read(bme280_dev_t *dev)
+{
+	struct bme280_data *data = dev->data;
+	uint8_t buf[BME280_BURST_SIZE] = { 0 };
+	uint64_t start = bme280_stats_time();
+	uint64_t ready;
+	uint32_t waits;
+	int ret;
+
+	/*
+	 * Sleep until the measurement started by CTRL_MEAS is due.  STATUS
+	 * and the data registers are contiguous, so read them in one burst
+	 * and poll only if the sensor is still busy.
+	 */
+	waits = bme280_meas_wait(data) ? 1 : 0;
+	for (uint32_t waited = 0; ; waited += BME280_POLL_US) {
+		ready = bme280_stats_time();
+		ret = bme280_burst_read(dev, buf);
+		if (ret < 0) {
+			return ret;
+		}
+
+		if (!(buf[0] & (BME280_STATUS_MEASURING |
+				BME280_STATUS_IM_UPDATE))) {
+			break;
+		}
+		if (waited >= bme280_meas_time_us(data->ctrl_meas,
+						  data->ctrl_hum) +
+			      BME280_POLL_TIMEOUT_US) {
+			return -ETIMEDOUT;
+		}
+
+		k_sleep(K_USEC(BME280_POLL_US));
+		waits++;
+	}
+	bme280_stats_wait(dev, start, ready, waits);
+	bme280_burst_compensate(dev, buf);
 
 	return 0;
 }
 
-static int bme280_channel_get(const struct device *dev,
+static int bme280_sample_fetch(bme280_dev_t *dev,
+			       enum sensor_channel chan)
+{
+	int ret;
+
+	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
+
+	ret = bme280_sample_start(dev);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return bme280_sample_read(dev);
+}
+
+#ifndef __NuttX__
+static int bme280_channel_get(bme280_dev_t *dev,
 			      enum sensor_channel chan,
 			      struct sensor_value *val)
 {
@@ -284,6 +628,7 @@ static int bme280_channel_get(const struct device *dev,
 
 	return 0;
 }
+#endif  //  !__NuttX__
 
 #ifndef __NuttX__
 static const struct sensor_driver_api bme280_api_funcs = {
@@ -292,64 +637,80 @@ static const struct sensor_driver_api bme280_api_funcs = {
 };
 #endif  //  !__NuttX__
 
-static int bme280_read_compensation(const struct device *dev)
+/* Derive the coefficients of the compensation code from the NVM. */
+static void bme280_derive_coeffs(struct bme280_data *data)
+{
+	struct bme280_calib cal;
+
+	/* Terms of the previous coefficients are stale. */
+	data->memo_valid = false;
+
+	bme280_calib_parse(&cal, data->nvm);
+	bme280_coeffs_init(&data->coeffs, &cal);
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+	bme280_fcoeffs_init(&data->fcoeffs, &cal);
+#endif
+}
+
+static int bme280_read_compensation(bme280_dev_t *dev)
 {
 	struct bme280_data *data = dev->data;
-	uint16_t buf[12];
-	uint8_t hbuf[7];
 	int err = 0;
 
-	err = bme280_reg_read(dev, BME280_REG_COMP_START,
-			      (uint8_t *)buf, sizeof(buf));
+	err = bme280_reg_read(dev, BME280_REG_COMP_START, data->nvm,
+			      BME280_NVM_H1);
 
 	if (err < 0) {
 		LOG_DBG("COMP_START read failed: %d" NL, err);
 		return err;
 	}
 
-	data->dig_t1 = sys_le16_to_cpu(buf[0]);
-	data->dig_t2 = sys_le16_to_cpu(buf[1]);
-	data->dig_t3 = sys_le16_to_cpu(buf[2]);
-
-	data->dig_p1 = sys_le16_to_cpu(buf[3]);
-	data->dig_p2 = sys_le16_to_cpu(buf[4]);
-	data->dig_p3 = sys_le16_to_cpu(buf[5]);
-	data->dig_p4 = sys_le16_to_cpu(buf[6]);
-	data->dig_p5 = sys_le16_to_cpu(buf[7]);
-	data->dig_p6 = sys_le16_to_cpu(buf[8]);
-	data->dig_p7 = sys_le16_to_cpu(buf[9]);
-	data->dig_p8 = sys_le16_to_cpu(buf[10]);
-	data->dig_p9 = sys_le16_to_cpu(buf[11]);
-
 	if (data->chip_id == BME280_CHIP_ID) {
 		err = bme280_reg_read(dev, BME280_REG_HUM_COMP_PART1,
-				      &data->dig_h1, 1);
+				      &data->nvm[BME280_NVM_H1], 1);
 		if (err < 0) {
 			LOG_DBG("HUM_COMP_PART1 read failed: %d" NL, err);
 			return err;
 		}
 
-		err = bme280_reg_read(dev, BME280_REG_HUM_COMP_PART2, hbuf, 7);
+		err = bme280_reg_read(dev, BME280_REG_HUM_COMP_PART2,
+				      &data->nvm[BME280_NVM_H2],
+				      BME280_NVM_SIZE - BME280_NVM_H2);
 		if (err < 0) {
 			LOG_DBG("HUM_COMP_PART2 read failed: %d" NL, err);
 			return err;
 		}
-
-		data->dig_h2 = (hbuf[1] << 8) | hbuf[0];
-		data->dig_h3 = hbuf[2];
-		data->dig_h4 = (hbuf[3] << 4) | (hbuf[4] & 0x0F);
-		data->dig_h5 = ((hbuf[4] >> 4) & 0x0F) | (hbuf[5] << 4);
-		data->dig_h6 = hbuf[6];
+	} else {
+		for (int i = BME280_NVM_H1; i < BME280_NVM_SIZE; i++) {
+			data->nvm[i] = 0;
+		}
 	}
 
+	bme280_derive_coeffs(data);
+
 	return 0;
 }
 
-static int bme280_chip_init(const struct device *dev)
+/*
+ * Write all control registers.  After soft reset or sleep, the chip may
+ * have been power cycled, so the shadow copy is not trusted.
+ */
+static int bme280_chip_config(bme280_dev_t *dev)
+{
+	struct bme280_data *data = dev->data;
+
+	data->shadow_valid = false;
+	return bme280_ctrl_write(dev, data->ctrl_hum, data->ctrl_meas,
+				 data->config, false);
+}
+
+static int bme280_chip_init(bme280_dev_t *dev)
 {
 	struct bme280_data *data = dev->data;
 	int err;
 
+	data->calibrated = false;
+
 	err = bme280_bus_check(dev);
 	if (err < 0) {
 		LOG_DBG("bus check failed: %d" NL, err);
@@ -377,65 +738,110 @@ static int bme280_chip_init(const struct device *dev)
 		LOG_DBG("Soft-reset failed: %d" NL, err);
 	}
 
-	err = bme280_wait_until_ready(dev);
+	/*
+	 * Soft reset puts an SPI sensor back into 4-wire mode, so check the
+	 * bus again once the sensor has restarted.
+	 */
+	k_sleep(K_USEC(BME280_STARTUP_US));
+	err = bme280_bus_check(dev);
 	if (err < 0) {
+		LOG_DBG("bus check failed: %d" NL, err);
 		return err;
 	}
 
-	err = bme280_read_compensation(dev);
+	err = bme280_wait_until_ready(dev, 0);
 	if (err < 0) {
 		return err;
 	}
 
-	if (data->chip_id == BME280_CHIP_ID) {
-		err = bme280_reg_write(dev, BME280_REG_CTRL_HUM,
-				       BME280_HUMIDITY_OVER);
-		if (err < 0) {
-			LOG_DBG("CTRL_HUM write failed: %d" NL, err);
-			return err;
-		}
-	}
-
-	err = bme280_reg_write(dev, BME280_REG_CTRL_MEAS,
-			       BME280_CTRL_MEAS_VAL);
+	err = bme280_read_compensation(dev);
 	if (err < 0) {
-		LOG_DBG("CTRL_MEAS write failed: %d" NL, err);
 		return err;
 	}
 
-	err = bme280_reg_write(dev, BME280_REG_CONFIG,
-			       BME280_CONFIG_VAL);
+	err = bme280_chip_config(dev);
 	if (err < 0) {
-		LOG_DBG("CONFIG write failed: %d" NL, err);
 		return err;
 	}
-	/* Wait for the sensor to be ready */
-	k_sleep(K_MSEC(1));
+	data->calibrated = true;
 
 	LOG_DBG("\"%s\" OK" NL, dev->name);
 	return 0;
 }
 
+/*
+ * Resume from sleep mode.  The compensation parameters survive sleep
+ * mode, so only the control registers are rewritten.  Fall back to a
+ * full init if the chip was never initialised or no longer answers
+ * with the same chip ID (e.g. it was power cycled or replaced).
+ */
+static int bme280_chip_resume(bme280_dev_t *dev)
+{
+	struct bme280_data *data = dev->data;
+	uint8_t chip_id;
+	int err;
+
+	if (!data->calibrated) {
+		return bme280_chip_init(dev);
+	}
+
+	err = bme280_reg_read(dev, BME280_REG_ID, &chip_id, 1);
+	if (err < 0 || chip_id != data->chip_id) {
+		LOG_DBG("chip changed, re-init" NL);
+		return bme280_chip_init(dev);
+	}
+
+	return bme280_chip_config(dev);
+}
+
+/*
+ * Change the control registers at runtime.  Only the registers that
+ * change are written, in one transfer.  While the chip is suspended the
+ * new values are only stored, and written on resume.
+ */
+static int bme280_chip_reconfigure(bme280_dev_t *dev,
+				   uint8_t ctrl_hum, uint8_t ctrl_meas,
+				   uint8_t config)
+{
+	struct bme280_data *data = dev->data;
+	int err;
+
+#ifdef CONFIG_PM_DEVICE
+	enum pm_device_state state;
+	(void)pm_device_state_get(dev, &state);
+	if (state == PM_DEVICE_STATE_ACTIVE)
+#endif
+	{
+		err = bme280_ctrl_write(dev, ctrl_hum, ctrl_meas, config,
+					false);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	data->ctrl_hum = ctrl_hum;
+	data->ctrl_meas = ctrl_meas;
+	data->config = config;
+	return 0;
+}
+
 #ifdef CONFIG_PM_DEVICE
-static int bme280_pm_action(const struct device *dev,
+static int bme280_pm_action(bme280_dev_t *dev,
 			    enum pm_device_action action)
 {
+	struct bme280_data *data = dev->data;
 	int ret = 0;
 
 	switch (action) {
 	case PM_DEVICE_ACTION_RESUME:
-		/* Re-initialize the chip */
-		ret = bme280_chip_init(dev);
+		/* Wake up the chip, re-initialize only if needed */
+		ret = bme280_chip_resume(dev);
 		break;
 	case PM_DEVICE_ACTION_SUSPEND:
 		/* Put the chip into sleep mode */
-		ret = bme280_reg_write(dev,
-			BME280_REG_CTRL_MEAS,
-			BME280_CTRL_MEAS_OFF_VAL);
-
-		if (ret < 0) {
-			LOG_DBG("CTRL_MEAS write failed: %d" NL, ret);
-		}
+		ret = bme280_ctrl_write(dev, data->ctrl_hum,
+					data->ctrl_meas & ~BME280_MODE_MASK,
+					data->config, false);
 		break;
 	default:
 		return -ENOTSUP;
@@ -466,7 +872,7 @@ static int bme280_pm_action(const struct device *dev,
  * instantiation macros for the instance.
  */
 #define BME280_DEFINE(inst)						\
-	static struct bme280_data bme280_data_##inst;			\
+	static struct bme280_data bme280_data_##inst = BME280_DATA_INIT; \
 	static const struct bme280_config bme280_config_##inst =	\
 		COND_CODE_1(DT_INST_ON_BUS(inst, spi),			\
 			    (BME280_CONFIG_SPI(inst)),			\
@@ -39,11 +39,15 @@ typedef int (*bme280_reg_read_fn)(const union bme280_bus *bus,
 				  uint8_t start, uint8_t *buf, int size);
 typedef int (*bme280_reg_write_fn)(const union bme280_bus *bus,
 				   uint8_t reg, uint8_t val);
+typedef int (*bme280_reg_write_multi_fn)(const union bme280_bus *bus,
+					 const uint8_t *pairs, int count);
 
 struct bme280_bus_io {
 	bme280_bus_check_fn check;
 	bme280_reg_read_fn read;
 	bme280_reg_write_fn write;
+	/* Optional: write count register/value pairs in one transfer */
+	bme280_reg_write_multi_fn write_multi;
 };
 
 #if BME280_BUS_SPI
@@ -75,9 +79,23 @@ extern const struct bme280_bus_io bme280_bus_io_i2c;
 #define BME280_MODE_FORCED              0x01
 #define BME280_MODE_NORMAL              0x03
 #define BME280_SPI_3W_DISABLE           0x00
+#define BME280_SPI_3W_ENABLE            0x01
 #define BME280_CMD_SOFT_RESET           0xB6
 #define BME280_STATUS_MEASURING         0x08
 #define BME280_STATUS_IM_UPDATE         0x01
+#define BME280_MODE_MASK                0x03
+#define BME280_OSRS_H_MASK              0x07
+#define BME280_STANDBY_MASK             (0x07 << 5)
+#define BME280_FILTER_MASK              (0x07 << 2)
+
+/* Time to copy the NVM after power-on or soft reset, in microseconds. */
+#define BME280_STARTUP_US               2000
+/* Interval between STATUS polls when the sensor is late, in microseconds. */
+#define BME280_POLL_US                  500
+/* Give up polling after this long past the expected ready time. */
+#define BME280_POLL_TIMEOUT_US          10000
+/* STATUS (0xF3) up to and including the data registers (0xFE). */
+#define BME280_BURST_SIZE               12
 
 #if defined CONFIG_BME280_MODE_NORMAL
 #define BME280_MODE BME280_MODE_NORMAL
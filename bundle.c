@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <debug.h>
 #include <assert.h>
+#include <nuttx/clock.h>
 
 //  Zephyr BME280 Options from
 //  https://github.com/zephyrproject-rtos/zephyr/blob/main/drivers/sensor/bme280/Kconfig
@@ -20,12 +21,19 @@
 #define CONFIG_PM_DEVICE                 //  Enable Power Management
 
 //  Other Zephyr Defines
-#define BME280_BUS_I2C  0  //  I2C Bus
-#define BME280_BUS_SPI  0  //  SPI Bus
+#define BME280_BUS_I2C  1  //  I2C Bus
+#ifdef CONFIG_SPI
+#define BME280_BUS_SPI  1  //  SPI Bus
+#else
+#define BME280_BUS_SPI  0  //  No SPI Bus
+#endif  //  CONFIG_SPI
 #define __ASSERT_NO_MSG DEBUGASSERT  //  Assertion check
 #define LOG_DBG         sninfo       //  Log info message
 #define K_MSEC(ms)      (ms * 1000)  //  Convert milliseconds to microseconds
+#define K_USEC(us)      (us)         //  Microseconds
 #define k_sleep(us)     usleep(us)   //  Sleep for microseconds
+#define k_uptime_ticks()  bme280_uptime_ticks()  //  System uptime in microseconds (see below)
+#define k_ticks_to_us_floor64(t)  (t)            //  Uptime is already in microseconds
 #define sys_le16_to_cpu(x) (x)       //  Convert from little endian to host endian. TODO: Handle big endian
 
 //  Zephyr Sensor Channel to be fetched from the sensor
@@ -48,31 +56,75 @@ enum pm_device_state {
     PM_DEVICE_STATE_SUSPENDED,  //  Sensor is suspended
 };
  
-//  Zephyr Sensor Value
-struct sensor_value {
-    int32_t val1;  //  Integer part of the value
-    int32_t val2;  //  Fractional part of the value (in one-millionth parts)
+//  Zephyr I2C Bus of a sensor: NuttX I2C Master, I2C Address and Frequency
+struct i2c_dt_spec {
+    struct i2c_master_s *bus;  //  I2C Master
+    uint16_t addr;             //  I2C Address (0x76 or 0x77)
+    uint32_t freq;             //  I2C Frequency in Hz
+};
+
+//  Zephyr SPI Bus of a sensor: NuttX SPI Device, Chip Select and Frequency
+struct spi_dt_spec {
+    struct spi_dev_s *bus;     //  SPI Device
+    uint32_t devid;            //  Device ID for SPI_SELECT
+    uint32_t freq;             //  SPI Frequency in Hz
+    bool three_wire;           //  True for 3-wire SPI (SDI as data in and out)
 };
 
 struct device;
 
+//  System uptime in microseconds.  clock_systime_ticks() counts whole
+//  ticks (10 ms by default), so a conversion time added to it would be
+//  waited for once more by the next check of the same deadline.
+static inline uint64_t bme280_uptime_ticks(void) {
+    struct timespec ts;
+    clock_systime_timespec(&ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 //  Get the device state (active / suspended)
 static int pm_device_state_get(const struct device *priv,
     enum pm_device_state *state);
 
-//  Check I2C Bus
-static int bme280_bus_check(const struct device *dev);
+//  Check I2C or SPI Bus
+static int bme280_bus_check(struct device *dev);
 
 //  Read Register
-static int bme280_reg_read(const struct device *dev,
+static int bme280_reg_read(struct device *dev,
     uint8_t start, uint8_t *buf, int size);
 
 //  Write Register
-static int bme280_reg_write(const struct device *dev, uint8_t reg,
+static int bme280_reg_write(struct device *dev, uint8_t reg,
     uint8_t val);
 
+//  Write Registers: count pairs of Register ID and value in one transfer
+static int bme280_reg_write_multi(struct device *dev,
+    const uint8_t *pairs, int count);
+
+#ifdef CONFIG_BME280_STATS
+//  Performance counter of the CPU, for the latency histograms
+static uint64_t bme280_stats_time(void);
+
+//  Record the wait for a measurement, from start until the sensor is ready
+static void bme280_stats_wait(struct device *dev, uint64_t start,
+    uint64_t ready, uint32_t waits);
+
+//  Record the compensation of a sample, since start
+static void bme280_stats_compensate(struct device *dev,
+    uint64_t start);
+#endif  //  CONFIG_BME280_STATS
+
+#ifdef CONFIG_BME280_RECORD
+//  Record the raw data burst of a measurement
+static void bme280_record_frame(struct device *dev,
+    const uint8_t *raw);
+#endif  //  CONFIG_BME280_RECORD
+
 //  Embed Zephyr BME280 Driver
 #include "bme280/bme280.c"
 
 //  Embed NuttX Driver Wrapper
 #include "bme280/driver.c"
+
+//  Embed Simulated BME280 for the NuttX Simulator
+#include "bme280/sim.c"
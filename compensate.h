@@ -0,0 +1,583 @@
+/* compensate.h - Compensation formulas for Bosch BME280 / BMP280 */
+
+/*
+ * Copyright (c) 2016, 2017 Intel Corporation
+ * Copyright (c) 2017 IpTronix S.r.l.
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The compensation code is kept free of driver state, so it may also be
+ * built on a host (like a gateway that compensates logged raw samples):
+ * every function takes the calibration block and the raw ADC values, and
+ * returns the compensated value.  Only <stdint.h> and <stddef.h> are
+ * needed.
+ */
+
+#ifndef BME280_COMPENSATE_H_
+#define BME280_COMPENSATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of samples per chunk of bme280_compensate_batch(). */
+#define BME280_BATCH_CHUNK 32
+
+/*
+ * Compensation parameters in the form used by the compensation code,
+ * derived once from the dig_* values after reading the calibration NVM.
+ * Shifts and casts are folded in, widest members first, so the whole
+ * block fits in one 64-byte cache line.
+ */
+struct bme280_coeffs {
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+	int32_t p4;		/* dig_P4 << 16 */
+	int32_t p5;		/* dig_P5 << 1 */
+#else
+	int64_t p4;		/* dig_P4 << 35 */
+	int64_t p5;		/* dig_P5 << 17 */
+	int32_t p2;		/* dig_P2 << 12 */
+	int32_t p7;		/* dig_P7 << 4 */
+#endif
+	int32_t t1x2;		/* dig_T1 << 1 */
+	int32_t h4;		/* dig_H4 << 20 */
+	int16_t t2;
+	int16_t t3;
+	uint16_t t1;
+	uint16_t p1;
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+	int16_t p2;
+	int16_t p7;
+#endif
+	int16_t p3;
+	int16_t p6;
+	int16_t p8;
+	int16_t p9;
+	int16_t h2;
+	int16_t h5;
+	uint8_t h1;
+	uint8_t h3;
+	int8_t h6;
+};
+
+/*
+ * Calibration NVM as read from the chip: 0x88 to 0x9F (dig_T1 to dig_P9),
+ * then 0xA1 (dig_H1) and 0xE1 to 0xE7 (dig_H2 to dig_H6).  The humidity
+ * bytes are zero on BMP280.
+ */
+#define BME280_NVM_SIZE 32
+#define BME280_NVM_H1 24	/* Offset of 0xA1 */
+#define BME280_NVM_H2 25	/* Offset of 0xE1 */
+
+/* Raw data burst, PRESS_MSB (0xF7) to HUM_LSB (0xFE). */
+#define BME280_RAW_SIZE 8
+
+/* Calibration parameters as stored in the NVM. */
+struct bme280_calib {
+	uint16_t dig_t1;
+	int16_t dig_t2;
+	int16_t dig_t3;
+	uint16_t dig_p1;
+	int16_t dig_p2;
+	int16_t dig_p3;
+	int16_t dig_p4;
+	int16_t dig_p5;
+	int16_t dig_p6;
+	int16_t dig_p7;
+	int16_t dig_p8;
+	int16_t dig_p9;
+	uint8_t dig_h1;
+	int16_t dig_h2;
+	uint8_t dig_h3;
+	int16_t dig_h4;
+	int16_t dig_h5;
+	int8_t dig_h6;
+};
+
+static inline uint16_t bme280_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/* Parse the calibration NVM, on hosts of either byte order. */
+static inline void bme280_calib_parse(struct bme280_calib *cal,
+				      const uint8_t *nvm)
+{
+	const uint8_t *h = &nvm[BME280_NVM_H2];
+
+	cal->dig_t1 = bme280_le16(&nvm[0]);
+	cal->dig_t2 = bme280_le16(&nvm[2]);
+	cal->dig_t3 = bme280_le16(&nvm[4]);
+
+	cal->dig_p1 = bme280_le16(&nvm[6]);
+	cal->dig_p2 = bme280_le16(&nvm[8]);
+	cal->dig_p3 = bme280_le16(&nvm[10]);
+	cal->dig_p4 = bme280_le16(&nvm[12]);
+	cal->dig_p5 = bme280_le16(&nvm[14]);
+	cal->dig_p6 = bme280_le16(&nvm[16]);
+	cal->dig_p7 = bme280_le16(&nvm[18]);
+	cal->dig_p8 = bme280_le16(&nvm[20]);
+	cal->dig_p9 = bme280_le16(&nvm[22]);
+
+	cal->dig_h1 = nvm[BME280_NVM_H1];
+	cal->dig_h2 = (h[1] << 8) | h[0];
+	cal->dig_h3 = h[2];
+	cal->dig_h4 = (h[3] << 4) | (h[4] & 0x0F);
+	cal->dig_h5 = ((h[4] >> 4) & 0x0F) | (h[5] << 4);
+	cal->dig_h6 = h[6];
+}
+
+/* Fold the shifts of the compensation formulas into the coefficients. */
+static inline void bme280_coeffs_init(struct bme280_coeffs *c,
+				      const struct bme280_calib *cal)
+{
+	c->t1 = cal->dig_t1;
+	c->t1x2 = (int32_t)cal->dig_t1 << 1;
+	c->t2 = cal->dig_t2;
+	c->t3 = cal->dig_t3;
+
+	c->p1 = cal->dig_p1;
+	c->p3 = cal->dig_p3;
+	c->p6 = cal->dig_p6;
+	c->p8 = cal->dig_p8;
+	c->p9 = cal->dig_p9;
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+	c->p2 = cal->dig_p2;
+	c->p4 = (int32_t)cal->dig_p4 << 16;
+	c->p5 = (int32_t)cal->dig_p5 << 1;
+	c->p7 = cal->dig_p7;
+#else
+	c->p2 = (int32_t)cal->dig_p2 << 12;
+	c->p4 = (int64_t)cal->dig_p4 << 35;
+	c->p5 = (int64_t)cal->dig_p5 << 17;
+	c->p7 = (int32_t)cal->dig_p7 << 4;
+#endif
+
+	c->h1 = cal->dig_h1;
+	c->h2 = cal->dig_h2;
+	c->h3 = cal->dig_h3;
+	c->h4 = (int32_t)cal->dig_h4 << 20;
+	c->h5 = cal->dig_h5;
+	c->h6 = cal->dig_h6;
+}
+
+/* Raw ADC values of a data burst.  adc_humidity is garbage on BMP280. */
+static inline void bme280_raw_decode(const uint8_t *raw, int32_t *adc_press,
+				     int32_t *adc_temp,
+				     int32_t *adc_humidity)
+{
+	*adc_press = (raw[0] << 12) | (raw[1] << 4) | (raw[2] >> 4);
+	*adc_temp = (raw[3] << 12) | (raw[4] << 4) | (raw[5] >> 4);
+	*adc_humidity = (raw[6] << 8) | raw[7];
+}
+
+/*
+ * Compensated values to DegC, hPa and %RH with one multiply each:
+ * comp_temp is in 0.01 DegC, comp_press in Pa with 8 fractional bits and
+ * comp_humidity in %RH with 10 fractional bits.
+ */
+static inline float bme280_temp_degc(int32_t comp_temp)
+{
+	return (float)comp_temp * 0.01f;
+}
+
+static inline float bme280_press_hpa(uint32_t comp_press)
+{
+	return (float)comp_press * (1.0f / 25600.0f);
+}
+
+static inline float bme280_humidity_rh(uint32_t comp_humidity)
+{
+	return (float)comp_humidity * (1.0f / 1024.0f);
+}
+
+/*
+ * Compensation code taken from BME280 datasheet, Section 4.2.3
+ * "Compensation formula".
+ */
+
+/* Temperature in the fine resolution carried over to pressure/humidity. */
+static inline int32_t bme280_comp_t_fine(const struct bme280_coeffs *c,
+					 int32_t adc_temp)
+{
+	int32_t var1, var2;
+
+	var1 = (((adc_temp >> 3) - c->t1x2) * c->t2) >> 11;
+	var2 = (((((adc_temp >> 4) - c->t1) *
+		  ((adc_temp >> 4) - c->t1)) >> 12) * c->t3) >> 14;
+
+	return var1 + var2;
+}
+
+/* Temperature in 0.01 DegC. */
+static inline int32_t bme280_comp_temp(int32_t t_fine)
+{
+	return (t_fine * 5 + 128) >> 8;
+}
+
+/*
+ * Terms of the pressure and humidity formulas that depend only on t_fine.
+ * They may be computed once and reused while the temperature is unchanged.
+ */
+struct bme280_terms {
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+	int32_t p_var1;		/* Divisor of the pressure formula */
+	int32_t p_var2;		/* Offset of the pressure formula */
+#else
+	int64_t p_var1;
+	int64_t p_var2;
+#endif
+	int32_t h_off;		/* Offset of the humidity formula */
+	int32_t h_scale;	/* Scale of the humidity formula */
+};
+
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+/*
+ * 32-bit pressure compensation from the BME280 datasheet, Section 8.2,
+ * for cores without fast 64-bit multiply and divide.  The resolution
+ * is 1 Pa instead of 1/256 Pa; the result keeps the 24.8 format.
+ * tools/bme280_accuracy.c checks it against the 64-bit formula.
+ */
+static inline void bme280_comp_press_terms(const struct bme280_coeffs *c,
+					   int32_t t_fine,
+					   struct bme280_terms *k)
+{
+	int32_t var1, var2;
+
+	var1 = (t_fine >> 1) - (int32_t)64000;
+	var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * c->p6;
+	var2 = var2 + var1 * c->p5;
+	var2 = (var2 >> 2) + c->p4;
+	var1 = (((c->p3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+		((c->p2 * var1) >> 1)) >> 18;
+	var1 = ((32768 + var1) * c->p1) >> 15;
+
+	k->p_var1 = var1;
+	k->p_var2 = var2;
+}
+
+static inline uint32_t bme280_comp_press_apply(const struct bme280_coeffs *c,
+					       const struct bme280_terms *k,
+					       int32_t adc_press)
+{
+	int32_t var1, var2;
+	uint32_t p;
+
+	/* Avoid exception caused by division by zero. */
+	if (k->p_var1 == 0) {
+		return 0U;
+	}
+
+	p = (((uint32_t)(((int32_t)1048576) - adc_press) -
+	      (k->p_var2 >> 12))) * 3125;
+	if (p < 0x80000000) {
+		p = (p << 1) / ((uint32_t)k->p_var1);
+	} else {
+		p = (p / (uint32_t)k->p_var1) * 2;
+	}
+	var1 = (c->p9 * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+	var2 = (((int32_t)(p >> 2)) * c->p8) >> 13;
+	p = (uint32_t)((int32_t)p + ((var1 + var2 + c->p7) >> 4));
+
+	return p << 8;
+}
+#else
+static inline void bme280_comp_press_terms(const struct bme280_coeffs *c,
+					   int32_t t_fine,
+					   struct bme280_terms *k)
+{
+	int64_t var1, var2;
+
+	var1 = ((int64_t)t_fine) - 128000;
+	var2 = var1 * var1 * c->p6;
+	var2 = var2 + var1 * c->p5;
+	var2 = var2 + c->p4;
+	var1 = ((var1 * var1 * c->p3) >> 8) + var1 * c->p2;
+	var1 = (((((int64_t)1) << 47) + var1)) * c->p1 >> 33;
+
+	k->p_var1 = var1;
+	k->p_var2 = var2;
+}
+
+/* Pressure in Pa as unsigned 32-bit integer in Q24.8 format. */
+static inline uint32_t bme280_comp_press_apply(const struct bme280_coeffs *c,
+					       const struct bme280_terms *k,
+					       int32_t adc_press)
+{
+	int64_t var1, var2, p;
+
+	/* Avoid exception caused by division by zero. */
+	if (k->p_var1 == 0) {
+		return 0U;
+	}
+
+	p = 1048576 - adc_press;
+	p = (((p << 31) - k->p_var2) * 3125) / k->p_var1;
+	var1 = (c->p9 * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (c->p8 * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + c->p7;
+
+	return (uint32_t)p;
+}
+#endif /* CONFIG_BME280_PRESS_COMP_32BIT */
+
+static inline uint32_t bme280_comp_press(const struct bme280_coeffs *c,
+					 int32_t t_fine, int32_t adc_press)
+{
+	struct bme280_terms k;
+
+	bme280_comp_press_terms(c, t_fine, &k);
+	return bme280_comp_press_apply(c, &k, adc_press);
+}
+
+static inline void bme280_comp_humidity_terms(const struct bme280_coeffs *c,
+					      int32_t t_fine,
+					      struct bme280_terms *k)
+{
+	int32_t h;
+
+	h = (t_fine - ((int32_t)76800));
+	k->h_off = c->h4 + (c->h5 * h);
+	k->h_scale = ((((((h * c->h6) >> 10) * (((h * c->h3) >> 11) +
+		((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
+		c->h2 + 8192) >> 14;
+}
+
+/* Humidity in %RH as unsigned 32-bit integer in Q22.10 format. */
+static inline uint32_t bme280_comp_humidity_apply(const struct bme280_coeffs *c,
+						  const struct bme280_terms *k,
+						  int32_t adc_humidity)
+{
+	int32_t h;
+
+	h = ((((adc_humidity << 14) - k->h_off) + ((int32_t)16384)) >> 15) *
+		k->h_scale;
+	h = (h - (((((h >> 15) * (h >> 15)) >> 7) * c->h1) >> 4));
+	h = (h > 419430400 ? 419430400 : h);
+
+	return (uint32_t)(h >> 12);
+}
+
+static inline uint32_t bme280_comp_humidity(const struct bme280_coeffs *c,
+					    int32_t t_fine,
+					    int32_t adc_humidity)
+{
+	struct bme280_terms k;
+
+	bme280_comp_humidity_terms(c, t_fine, &k);
+	return bme280_comp_humidity_apply(c, &k, adc_humidity);
+}
+
+/*
+ * Compensation parameters for the floating-point formulas, with the
+ * divisions by powers of two (and dig_P1 in the pressure formula) folded
+ * in, so each formula is a few multiply-adds.
+ */
+struct bme280_fcoeffs {
+	float t1;		/* dig_T1 * 16 */
+	float t2;		/* dig_T2 / 2^14 */
+	float t3;		/* dig_T3 / 2^34 */
+	float p1;		/* dig_P1 */
+	float p2;		/* dig_P2 * dig_P1 / 2^34 */
+	float p3;		/* dig_P3 * dig_P1 / 2^53 */
+	float p4;		/* dig_P4 * 16 */
+	float p5;		/* dig_P5 / 2^13 */
+	float p6;		/* dig_P6 / 2^29 */
+	float p7;		/* dig_P7 / 16 */
+	float p8;		/* dig_P8 / 2^19 */
+	float p9;		/* dig_P9 / 2^35 */
+	float h1;		/* dig_H1 / 2^19 */
+	float h2;		/* dig_H2 / 2^16 */
+	float h3;		/* dig_H3 / 2^26 */
+	float h4;		/* dig_H4 * 64 */
+	float h5;		/* dig_H5 / 2^14 */
+	float h6;		/* dig_H6 / 2^26 */
+};
+
+/* Fold the divisions of the floating-point formulas into the coefficients. */
+static inline void bme280_fcoeffs_init(struct bme280_fcoeffs *f,
+				       const struct bme280_calib *cal)
+{
+	f->t1 = cal->dig_t1 * 16.0f;
+	f->t2 = cal->dig_t2 / 16384.0f;
+	f->t3 = cal->dig_t3 / 17179869184.0f;
+
+	f->p1 = cal->dig_p1;
+	f->p2 = cal->dig_p2 * (float)cal->dig_p1 / 17179869184.0f;
+	f->p3 = cal->dig_p3 * (float)cal->dig_p1 / 9007199254740992.0f;
+	f->p4 = cal->dig_p4 * 16.0f;
+	f->p5 = cal->dig_p5 / 8192.0f;
+	f->p6 = cal->dig_p6 / 536870912.0f;
+	f->p7 = cal->dig_p7 / 16.0f;
+	f->p8 = cal->dig_p8 / 524288.0f;
+	f->p9 = cal->dig_p9 / 34359738368.0f;
+
+	f->h1 = cal->dig_h1 / 524288.0f;
+	f->h2 = cal->dig_h2 / 65536.0f;
+	f->h3 = cal->dig_h3 / 67108864.0f;
+	f->h4 = cal->dig_h4 * 64.0f;
+	f->h5 = cal->dig_h5 / 16384.0f;
+	f->h6 = cal->dig_h6 / 67108864.0f;
+}
+
+/*
+ * Floating-point compensation from the BME280 datasheet, Section 8.1,
+ * in single precision for cores with a float-only FPU.
+ */
+
+/* Temperature in the fine resolution carried over to pressure/humidity. */
+static inline float bme280_compf_t_fine(const struct bme280_fcoeffs *c,
+					int32_t adc_temp)
+{
+	float x = (float)adc_temp - c->t1;
+
+	return x * c->t2 + x * x * c->t3;
+}
+
+/* Temperature in DegC. */
+static inline float bme280_compf_temp(float t_fine)
+{
+	return t_fine * (1.0f / 5120.0f);
+}
+
+/* Terms of the floating-point formulas that depend only on t_fine. */
+struct bme280_fterms {
+	float p_scale;		/* 6250 / divisor of the pressure formula */
+	float p_var2;		/* Offset of the pressure formula */
+	float h_off;		/* Offset of the humidity formula */
+	float h_scale;		/* Scale of the humidity formula */
+};
+
+static inline void bme280_compf_press_terms(const struct bme280_fcoeffs *c,
+					    float t_fine,
+					    struct bme280_fterms *k)
+{
+	float var1;
+
+	var1 = t_fine * 0.5f - 64000.0f;
+	k->p_var2 = (var1 * c->p6 + c->p5) * var1 + c->p4;
+	var1 = (var1 * c->p3 + c->p2) * var1 + c->p1;
+
+	/* Avoid exception caused by division by zero. */
+	k->p_scale = (var1 == 0.0f) ? 0.0f : 6250.0f / var1;
+}
+
+/* Pressure in Pa. */
+static inline float bme280_compf_press_apply(const struct bme280_fcoeffs *c,
+					     const struct bme280_fterms *k,
+					     int32_t adc_press)
+{
+	float p;
+
+	if (k->p_scale == 0.0f) {
+		return 0.0f;
+	}
+
+	p = (1048576.0f - (float)adc_press - k->p_var2) * k->p_scale;
+
+	return (p * c->p9 + c->p8 + 1.0f) * p + c->p7;
+}
+
+static inline float bme280_compf_press(const struct bme280_fcoeffs *c,
+				       float t_fine, int32_t adc_press)
+{
+	struct bme280_fterms k;
+
+	bme280_compf_press_terms(c, t_fine, &k);
+	return bme280_compf_press_apply(c, &k, adc_press);
+}
+
+static inline void bme280_compf_humidity_terms(const struct bme280_fcoeffs *c,
+					       float t_fine,
+					       struct bme280_fterms *k)
+{
+	float var_h = t_fine - 76800.0f;
+
+	k->h_off = c->h4 + c->h5 * var_h;
+	k->h_scale = c->h2 * (1.0f + c->h6 * var_h * (1.0f + c->h3 * var_h));
+}
+
+/* Humidity in %RH. */
+static inline float bme280_compf_humidity_apply(const struct bme280_fcoeffs *c,
+						const struct bme280_fterms *k,
+						int32_t adc_humidity)
+{
+	float var_h;
+
+	var_h = ((float)adc_humidity - k->h_off) * k->h_scale;
+	var_h = var_h * (1.0f - c->h1 * var_h);
+
+	if (var_h > 100.0f) {
+		var_h = 100.0f;
+	} else if (var_h < 0.0f) {
+		var_h = 0.0f;
+	}
+
+	return var_h;
+}
+
+static inline float bme280_compf_humidity(const struct bme280_fcoeffs *c,
+					  float t_fine, int32_t adc_humidity)
+{
+	struct bme280_fterms k;
+
+	bme280_compf_humidity_terms(c, t_fine, &k);
+	return bme280_compf_humidity_apply(c, &k, adc_humidity);
+}
+
+/*
+ * Compensate count raw samples in structure-of-arrays form with one
+ * calibration block.  The input and output arrays must not overlap.
+ * adc_humidity and humidity may be NULL (BMP280).
+ *
+ * Samples are processed in chunks of BME280_BATCH_CHUNK, one formula per
+ * loop, so the temperature and humidity loops have no branches or calls
+ * and may be vectorized by the compiler.  The pressure loop is bound by
+ * the division per sample.
+ */
+static inline void bme280_compensate_batch(const struct bme280_coeffs *c,
+					   const int32_t *restrict adc_temp,
+					   const int32_t *restrict adc_press,
+					   const int32_t *restrict adc_humidity,
+					   int32_t *restrict temp,
+					   uint32_t *restrict press,
+					   uint32_t *restrict humidity,
+					   size_t count)
+{
+	const struct bme280_coeffs k = *c;
+	int32_t t_fine[BME280_BATCH_CHUNK];
+
+	while (count > 0) {
+		size_t n = count < BME280_BATCH_CHUNK ?
+			count : BME280_BATCH_CHUNK;
+
+		for (size_t i = 0; i < n; i++) {
+			t_fine[i] = bme280_comp_t_fine(&k, adc_temp[i]);
+			temp[i] = bme280_comp_temp(t_fine[i]);
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			press[i] = bme280_comp_press(&k, t_fine[i],
+						     adc_press[i]);
+		}
+
+		if (adc_humidity != NULL && humidity != NULL) {
+			for (size_t i = 0; i < n; i++) {
+				humidity[i] = bme280_comp_humidity(
+					&k, t_fine[i], adc_humidity[i]);
+			}
+			adc_humidity += n;
+			humidity += n;
+		}
+
+		adc_temp += n;
+		adc_press += n;
+		temp += n;
+		press += n;
+		count -= n;
+	}
+}
+
+#endif /* BME280_COMPENSATE_H_ */
@@ -26,26 +26,172 @@
  ****************************************************************************/
 
 #include <nuttx/config.h>
+#include <nuttx/sensors/bme280.h>
+
+#ifdef CONFIG_BME280_WORKER
+#  include <nuttx/mutex.h>
+#  include <nuttx/wqueue.h>
+#endif
+
+#if defined(CONFIG_BME280_TRACE) || defined(CONFIG_BME280_RECORD)
+#  include <nuttx/atomic.h>
+#endif
 
 #if defined(CONFIG_I2C) && (defined(CONFIG_SENSORS_BME280) || defined(CONFIG_SENSORS_BME280_SCU))
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Number of samples kept by the background worker */
+
+#ifndef CONFIG_BME280_RING_SIZE
+#  define CONFIG_BME280_RING_SIZE 8
+#endif
+
+#if CONFIG_BME280_RING_SIZE > 255
+#  error "CONFIG_BME280_RING_SIZE must fit the uint8_t ring indexes"
+#endif
+
+/* Number of trace events kept per device, a power of two */
+
+#ifndef CONFIG_BME280_TRACE_SIZE
+#  define CONFIG_BME280_TRACE_SIZE 128
+#endif
+
+#if (CONFIG_BME280_TRACE_SIZE & (CONFIG_BME280_TRACE_SIZE - 1)) != 0
+#  error "CONFIG_BME280_TRACE_SIZE must be a power of two"
+#endif
+
+/* Number of raw frames recorded per device, a power of two */
+
+#ifndef CONFIG_BME280_RECORD_SIZE
+#  define CONFIG_BME280_RECORD_SIZE 64
+#endif
+
+#if (CONFIG_BME280_RECORD_SIZE & (CONFIG_BME280_RECORD_SIZE - 1)) != 0
+#  error "CONFIG_BME280_RECORD_SIZE must be a power of two"
+#endif
+
+/* Push Mode publishes the samples of the worker */
+
+#if defined(CONFIG_BME280_PUSH_MODE) && !defined(CONFIG_BME280_WORKER)
+#  error "CONFIG_BME280_PUSH_MODE requires CONFIG_BME280_WORKER"
+#endif
+
+/* Dual Mode merges two sensors, sampled by the worker */
+
+#if defined(CONFIG_BME280_DUAL) && !defined(CONFIG_BME280_WORKER)
+#  error "CONFIG_BME280_DUAL requires CONFIG_BME280_WORKER"
+#endif
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+/* Sample of the Barometer and Humidity Sensors from one measurement */
+
+struct bme280_sample_s
+{
+  struct sensor_baro baro;      /* Pressure and temperature */
+  struct sensor_humi humi;      /* Humidity */
+};
+
 /* NuttX Device for BME280 */
 
 struct device
 {
   FAR struct sensor_lowerhalf_s sensor_baro;  /* Barometer and Temperature Sensor */
   FAR struct sensor_lowerhalf_s sensor_humi;  /* Humidity Sensor */
-  FAR struct i2c_master_s *i2c; /* I2C interface */
-  uint8_t addr;                 /* BME280 I2C address */
-  int freq;                     /* BME280 Frequency <= 3.4MHz */
+  union bme280_bus bus;         /* I2C or SPI Bus of BME280 */
+  FAR const struct bme280_bus_io *bus_io;  /* Transport for the bus */
+#ifdef CONFIG_BME280_I2C_PROBE
+  uint32_t freq_fallbacks;      /* I2C frequency steps down after errors */
+  uint32_t freq_probed;         /* I2C frequency found by the probe */
+  uint64_t fallback_us;         /* Time of the last step down, 0 if none */
+#endif
   bool activated;               /* True if device is not in sleep mode */
 
   char *name;                   /* Name of the device */
   struct bme280_data *data;     /* Compensation parameters (bme280.c) */
+
+  /* Latest sample, shared by Barometer and Humidity Sensors */
+
+  struct sensor_baro baro;      /* Latest pressure and temperature */
+  struct sensor_humi humi;      /* Latest humidity */
+  struct bme280_fixed_s fixed;  /* Latest sample in fixed-point */
+  bool cached;                  /* True if latest sample is valid */
+  unsigned long cache_us;       /* Freshness window of latest sample */
+  uint32_t cache_hits;          /* Fetches served from latest sample */
+  uint32_t cache_misses;        /* Fetches that read the sensor */
+  unsigned long request_us;     /* Requested interval, 0 if not set */
+
+#ifdef CONFIG_BME280_STATS
+  struct bme280_stats_s stats;  /* Performance counters and histograms */
+#endif
+
+#ifdef CONFIG_BME280_TRACE
+  /* Binary trace events.  Writers claim a slot by incrementing
+   * trace_head, without locking.
+   */
+
+  struct bme280_trace_s trace[CONFIG_BME280_TRACE_SIZE];
+  atomic_uint trace_head;       /* Number of events recorded */
+  uint32_t trace_tail;          /* Number of events read or dropped */
+#endif
+
+#ifdef CONFIG_BME280_RECORD
+  /* Raw data bursts, recorded like the trace events */
+
+  struct bme280_frame_s record[CONFIG_BME280_RECORD_SIZE];
+  atomic_uint record_head;      /* Number of frames recorded */
+  uint32_t record_tail;         /* Number of frames read or dropped */
+#endif
+
+#ifdef CONFIG_BME280_WORKER
+  /* Background sampling into a ring buffer */
+
+  mutex_t lock;                 /* Serializes the worker and callers */
+  struct work_s work;           /* Sampling work on the LP work queue */
+  unsigned long interval_us;    /* Sampling interval */
+  struct sensor_baro ring_baro[CONFIG_BME280_RING_SIZE];
+  struct sensor_humi ring_humi[CONFIG_BME280_RING_SIZE];
+  uint8_t ring_head;            /* Index of the newest sample */
+  uint8_t ring_count;           /* Number of samples in ring */
+#endif
+
+#ifdef CONFIG_BME280_PUSH_MODE
+  /* Samples are pushed to the subscribers in batches */
+
+  unsigned long latency_us;     /* Batch latency requested by subscribers */
+  uint8_t batch_size;           /* Samples per push event */
+  uint8_t ring_pending;         /* Samples in ring not pushed yet */
+  uint32_t push_events;         /* Batches pushed per sensor */
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+  /* Second sensor, measuring half a period after this one.  Both are
+   * merged into the stream of this device.
+   */
+
+  FAR struct device *peer;      /* Second sensor, NULL if single */
+  uint32_t period_us;           /* Nominal Normal Mode period of each */
+  uint64_t start_us[2];         /* Start of Normal Mode, 0 if stopped */
+  uint64_t done_us[2];          /* Estimated completion of the last sample
+                                 * read, 0 if none since start */
+  uint64_t seen_us[2];          /* Last read without a new sample, 0 if
+                                 * none since the last sample */
+  uint32_t cycle_us[2];         /* Estimated period, 0 if unknown */
+  uint32_t meas_us[2];          /* Estimated measurement time, 0 if
+                                 * unknown */
+  uint32_t window_us[2];        /* Reading starts this long before the
+                                 * predicted completion */
+  uint8_t burst[2][BME280_BURST_SIZE];  /* Last burst read of each */
+  uint32_t resyncs;             /* Restarts of the second sensor */
+  struct bme280_sample_s last[2];   /* Last sample of each, uncorrected */
+  struct bme280_offset_s offset;    /* Offset of second sensor from first */
+  uint32_t noffset;             /* Number of offset estimates */
+#endif
 };
 
 #endif /* CONFIG_I2C && (CONFIG_SENSORS_BME280 || CONFIG_SENSORS_BME280_SCU) */
@@ -25,25 +25,153 @@
 #include <nuttx/config.h>
 #include <nuttx/nuttx.h>
 
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
 #include <fixedmath.h>
 #include <errno.h>
 #include <debug.h>
 
 #include <nuttx/kmalloc.h>
+#include <nuttx/clock.h>
+#include <nuttx/mutex.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/i2c/i2c_master.h>
 #include <nuttx/sensors/bme280.h>
 #include <nuttx/sensors/sensor.h>
 
+#ifdef CONFIG_SPI
+#  include <nuttx/spi/spi.h>
+#endif
+
+#include "trace.h"
+
 #if defined(CONFIG_I2C) && defined(CONFIG_SENSORS_BME280)
 
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define BME280_ADDR         0x77
+#ifndef CONFIG_BME280_I2C_ADDRESS
+#  define CONFIG_BME280_I2C_ADDRESS BME280_I2C_ADDR_SECONDARY
+#endif
+
+#define BME280_ADDR         CONFIG_BME280_I2C_ADDRESS
 #define BME280_FREQ         CONFIG_BME280_I2C_FREQUENCY
+#define BME280_FREQ_MAX     3400000
+
+/* SPI Mode 3 (Mode 0 works too), Register ID with bit 7 set for reads
+ * (BME280 Datasheet, Section 6.3).  A multiple write sends at most the
+ * four pairs of bme280_ctrl_write.
+ */
+
+#define BME280_SPI_MODE      SPIDEV_MODE3
+#define BME280_SPI_READ      0x80
+#define BME280_SPI_WRITE_MAX 4
+#define BME280_SPI_FREQ_MAX  10000000
+
+/* With CONFIG_BME280_I2C_PROBE, the I2C frequency of each sensor is
+ * probed at registration, up to the requested frequency, and stepped
+ * down when a transfer fails with a bus error.  The probe is repeated
+ * CONFIG_BME280_I2C_REPROBE_USEC after the last step down.
+ */
+
+#ifdef CONFIG_BME280_I2C_PROBE
+#  ifndef CONFIG_BME280_I2C_REPROBE_USEC
+#    define CONFIG_BME280_I2C_REPROBE_USEC 60000000
+#  endif
+#  define BME280_I2C_NSPEEDS   4
+#  define BME280_PROBE_NVM_LEN 26   /* 0x88 to 0xA1 */
+#else
+#  define bme280_i2c_fallback(priv, ret) false
+#  define bme280_i2c_reprobe(priv)
+#endif
+
+/* With CONFIG_BME280_STATS, each device counts its bus transfers and
+ * keeps latency histograms of the bus, wait and compensation phases.
+ */
+
+#ifndef CONFIG_BME280_STATS
+#  define bme280_stats_bus(priv, begin, nbytes, ret) ((void)(begin))
+#endif
+
+/* With CONFIG_BME280_TRACE, bus transfers, fetches and activations are
+ * recorded as binary events in a ring per device, instead of formatting
+ * them with sninfo.
+ */
+
+#ifdef CONFIG_BME280_TRACE
+#  define BME280_TRACE_MASK (CONFIG_BME280_TRACE_SIZE - 1)
+#  define bme280_info(...)
+#else
+#  define bme280_info(...) sninfo(__VA_ARGS__)
+#  define bme280_trace(priv, event, reg, len, result) \
+     ((void)(reg), (void)(len), (void)(result))
+#endif
+
+/* Freshness window of the latest sample.  Within this window, fetching
+ * the Barometer and Humidity Sensors reads the sensor only once.
+ */
+
+#ifndef CONFIG_BME280_CACHE_USEC
+#  define CONFIG_BME280_CACHE_USEC 10000
+#endif
+
+/* With CONFIG_BME280_WORKER, the worker samples the sensor in the
+ * background and the callers only copy the newest sample.  The lock
+ * serializes the worker and the callers on the bus and device state.
+ * A newest sample older than two intervals means the worker is stalled
+ * (e.g. on a starved work queue), so the callers read the sensor.
+ */
+
+#ifdef CONFIG_BME280_WORKER
+#  ifndef CONFIG_BME280_WORKER_INTERVAL_USEC
+#    define CONFIG_BME280_WORKER_INTERVAL_USEC 1000000
+#  endif
+#  define BME280_RING_MAX_AGE(priv) (2 * (uint64_t)(priv)->interval_us)
+#  define bme280_lock(priv)   nxmutex_lock(&(priv)->lock)
+#  define bme280_unlock(priv) nxmutex_unlock(&(priv)->lock)
+#else
+#  define bme280_lock(priv)
+#  define bme280_unlock(priv)
+#endif
+
+/* With CONFIG_BME280_SCHEDULER, registered devices are kept in a registry
+ * so that all sensors on a bus may be sampled in one cycle.
+ */
+
+#ifdef CONFIG_BME280_SCHEDULER
+#  ifndef CONFIG_BME280_SCHEDULER_NDEVICES
+#    define CONFIG_BME280_SCHEDULER_NDEVICES 4
+#  endif
+#endif
+
+/* In Dual Mode, each new estimate of the offset of the second sensor
+ * counts for 1 / 2^CONFIG_BME280_DUAL_CAL_SHIFT of the offset.
+ */
+
+#ifdef CONFIG_BME280_DUAL
+#  ifndef CONFIG_BME280_DUAL_CAL_SHIFT
+#    define CONFIG_BME280_DUAL_CAL_SHIFT 4
+#  endif
+#endif
+
+/* In Dual Mode, each sensor is read from CONFIG_BME280_DUAL_WINDOW_US
+ * before its predicted completion, and the second sensor is started again
+ * when it drifts by more than 1 / 2^CONFIG_BME280_DUAL_RESYNC_SHIFT of a
+ * period from half a period after the first.
+ */
+
+#ifdef CONFIG_BME280_DUAL
+#  ifndef CONFIG_BME280_DUAL_WINDOW_US
+#    define CONFIG_BME280_DUAL_WINDOW_US 1000
+#  endif
+#  ifndef CONFIG_BME280_DUAL_RESYNC_SHIFT
+#    define CONFIG_BME280_DUAL_RESYNC_SHIFT 6
+#  endif
+#endif
 
 /****************************************************************************
  * Private Function Prototypes
@@ -63,24 +191,116 @@ static int bme280_activate_baro(FAR struct sensor_lowerhalf_s *lower,
 static int bme280_activate_humi(FAR struct sensor_lowerhalf_s *lower,
                            FAR struct file *filep,
                            bool enable);
+#ifdef CONFIG_BME280_PUSH_MODE
+static int bme280_batch_baro(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR unsigned long *latency_us);
+static int bme280_batch_humi(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR unsigned long *latency_us);
+#else
 static int bme280_fetch_baro(FAR struct sensor_lowerhalf_s *lower,
                         FAR struct file *filep,
                         FAR char *buffer, size_t buflen);
 static int bme280_fetch_humi(FAR struct sensor_lowerhalf_s *lower,
                         FAR struct file *filep,
                         FAR char *buffer, size_t buflen);
+#endif
+static int bme280_control_baro(FAR struct sensor_lowerhalf_s *lower,
+                          FAR struct file *filep,
+                          int cmd, unsigned long arg);
+static int bme280_control_humi(FAR struct sensor_lowerhalf_s *lower,
+                          FAR struct file *filep,
+                          int cmd, unsigned long arg);
+
+/* I2C and SPI transports */
+
+static int bme280_i2c_check(FAR const union bme280_bus *bus);
+static int bme280_i2c_read(FAR const union bme280_bus *bus,
+    uint8_t start, uint8_t *buf, int size);
+static int bme280_i2c_write(FAR const union bme280_bus *bus, uint8_t reg,
+    uint8_t val);
+static int bme280_i2c_write_multi(FAR const union bme280_bus *bus,
+    const uint8_t *pairs, int count);
+#ifdef CONFIG_BME280_I2C_PROBE
+static bool bme280_i2c_fallback(FAR struct device *priv, int ret);
+static void bme280_i2c_reprobe(FAR struct device *priv);
+#endif
+#ifdef CONFIG_SPI
+static int bme280_spi_check(FAR const union bme280_bus *bus);
+static int bme280_spi_read(FAR const union bme280_bus *bus,
+                           uint8_t start, uint8_t *buf, int size);
+static int bme280_spi_write(FAR const union bme280_bus *bus, uint8_t reg,
+                            uint8_t val);
+static int bme280_spi_write_multi(FAR const union bme280_bus *bus,
+                                  const uint8_t *pairs, int count);
+#endif
+
+/* Power mode and background sampling */
+
+static int bme280_enable(FAR struct device *priv, bool enable);
+#ifdef CONFIG_BME280_WORKER
+static void bme280_worker(FAR void *arg);
+#endif
+#ifdef CONFIG_BME280_DUAL
+static int bme280_dual_restart(FAR struct device *priv);
+#endif
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
+/* Standby Duration in microseconds for each value of t_sb in CONFIG.
+ * BMP280 and BME280 differ in the last two (BMP280 Datasheet Table 11,
+ * BME280 Datasheet Table 27).
+ */
+
+static const uint32_t g_bmp280_standby_us[8] =
+{
+  500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000
+};
+
+static const uint32_t g_bme280_standby_us[8] =
+{
+  500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000
+};
+
+#ifdef CONFIG_BME280_I2C_PROBE
+/* I2C Standard-mode, Fast-mode, Fast-mode Plus and High-speed mode */
+
+static const uint32_t g_bme280_i2c_speeds[BME280_I2C_NSPEEDS] =
+{
+  I2C_SPEED_STANDARD, I2C_SPEED_FAST, I2C_SPEED_FAST_PLUS, I2C_SPEED_HIGH
+};
+#endif
+
+#ifdef CONFIG_BME280_SCHEDULER
+/* Registered devices, in order of registration */
+
+static FAR struct device *g_bme280_devices[CONFIG_BME280_SCHEDULER_NDEVICES];
+static mutex_t g_bme280_devices_lock = NXMUTEX_INITIALIZER;
+#endif
+
+#ifdef CONFIG_SENSORS_BME280_SIM
+/* Device registered last, so the simulator benchmark can reach the
+ * devices it registers through the public functions
+ */
+
+static FAR struct device *g_bme280_registered;
+#endif
+
 /* Operations for Barometer and Temperature Sensor */
 
 static const struct sensor_ops_s g_baro_ops =
 {
   .activate      = bme280_activate_baro,
+#ifdef CONFIG_BME280_PUSH_MODE
+  .batch         = bme280_batch_baro,
+#else
   .fetch         = bme280_fetch_baro,
+#endif
   .set_interval  = bme280_set_interval_baro,
+  .control       = bme280_control_baro,
 };
 
 /* Operations for Humidity Sensor */
@@ -88,712 +308,3370 @@ static const struct sensor_ops_s g_baro_ops =
 static const struct sensor_ops_s g_humi_ops =
 {
   .activate      = bme280_activate_humi,
+#ifdef CONFIG_BME280_PUSH_MODE
+  .batch         = bme280_batch_humi,
+#else
   .fetch         = bme280_fetch_humi,
+#endif
   .set_interval  = bme280_set_interval_humi,
+  .control       = bme280_control_humi,
+};
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* Transports for the bus of each device (bme280.h) */
+
+const struct bme280_bus_io bme280_bus_io_i2c =
+{
+  .check       = bme280_i2c_check,
+  .read        = bme280_i2c_read,
+  .write       = bme280_i2c_write,
+  .write_multi = bme280_i2c_write_multi,
+};
+
+#ifdef CONFIG_SPI
+const struct bme280_bus_io bme280_bus_io_spi =
+{
+  .check       = bme280_spi_check,
+  .read        = bme280_spi_read,
+  .write       = bme280_spi_write,
+  .write_multi = bme280_spi_write_multi,
 };
+#endif
 
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
 /****************************************************************************
- * Name: get_sensor_value
+ * Name: bme280_now
  *
  * Description:
- *   Return the sensor value as a float
+ *   Return the current time in microseconds
  *
  ****************************************************************************/
 
-static float get_sensor_value(const struct sensor_value *val)
+static uint64_t bme280_now(void)
 {
-  DEBUGASSERT(val != NULL);
-  return 
-    (float)(val->val1) +
-    (float)(val->val2) / 1000000.0f;
+  struct timespec ts;
+
+  clock_systime_timespec(&ts);
+  return 1000000ull * ts.tv_sec + ts.tv_nsec / 1000;
 }
 
+#ifdef CONFIG_BME280_STATS
 /****************************************************************************
- * Name: pm_device_state_get
+ * Name: bme280_stats_time
  *
  * Description:
- *   Get the device state (active / suspended)
+ *   Return the performance counter of the CPU, for the latency histograms
  *
  ****************************************************************************/
 
-static int pm_device_state_get(const struct device *priv,
-  enum pm_device_state *state)
+static uint64_t bme280_stats_time(void)
 {
-  DEBUGASSERT(priv != NULL);
-  DEBUGASSERT(state != NULL);
-  if (priv->activated)
-    {
-      *state = PM_DEVICE_STATE_ACTIVE;
-    }
-  else
-    {
-      *state = PM_DEVICE_STATE_SUSPENDED;
-    }
-  return 0;  
+  return perf_gettime();
 }
 
 /****************************************************************************
- * Name: bme280_bus_check
+ * Name: bme280_stats_hist
  *
  * Description:
- *   Check I2C Bus
+ *   Count the latency from start to end in its log2 bucket of hist
  *
  ****************************************************************************/
 
-static int bme280_bus_check(const struct device *priv)
+static void bme280_stats_hist(FAR uint32_t *hist, uint64_t start,
+                              uint64_t end)
 {
-  DEBUGASSERT(priv != NULL);
-  return 0;
+  struct timespec ts;
+  uint64_t ns;
+  int n = 0;
+
+  /* The performance counter may be narrower than 64 bits and wrap */
+
+  perf_convert((clock_t)(end - start), &ts);
+  ns = 1000000000ull * ts.tv_sec + ts.tv_nsec;
+  while (ns != 0 && n < BME280_STATS_NBUCKETS - 1)
+    {
+      ns >>= 1;
+      n++;
+    }
+
+  hist[n]++;
 }
 
 /****************************************************************************
- * Name: bme280_reg_read
+ * Name: bme280_stats_bus
  *
  * Description:
- *   Read from 8-bit BME280 registers
+ *   Record a bus transfer of nbytes that started at begin and returned ret
  *
  ****************************************************************************/
 
-static int bme280_reg_read(const struct device *priv,
-    uint8_t start, uint8_t *buf, int size)
+static void bme280_stats_bus(FAR struct device *priv, uint64_t begin,
+                             int nbytes, int ret)
 {
-  DEBUGASSERT(priv != NULL);
-  DEBUGASSERT(buf != NULL);
-  struct i2c_msg_s msg[2];
-  int ret;
-
-  msg[0].frequency = priv->freq;
-  msg[0].addr      = priv->addr;
-#ifdef CONFIG_BL602_I2C0
-  //  For BL602: Register ID must be passed as I2C Sub Address
-  msg[0].flags     = I2C_M_NOSTOP;
-#else
-  //  Otherwise pass Register ID as I2C Data
-  msg[0].flags     = 0;
-#endif  //  CONFIG_BL602_I2C0
-  msg[0].buffer    = &start;
-  msg[0].length    = 1;
-
-  msg[1].frequency = priv->freq;
-  msg[1].addr      = priv->addr;
-  msg[1].flags     = I2C_M_READ;
-  msg[1].buffer    = buf;
-  msg[1].length    = size;
-
-  ret = I2C_TRANSFER(priv->i2c, msg, 2);
+  priv->stats.transfers++;
   if (ret < 0)
     {
-      sninfo("start=0x%02x, size=%d\n", start, size);
-      snerr("I2C_TRANSFER failed: %d\n", ret);
-      return -1;
-    }
-
-  if (size == 1)
-    {
-      sninfo("start=0x%02x, size=%d, buf[0]=0x%02x\n", start, size, buf[0]);
+      priv->stats.errors++;
     }
   else
     {
-      sninfo("start=0x%02x, size=%d\n", start, size);
+      priv->stats.bytes += nbytes;
     }
-  return OK;
+
+  bme280_stats_hist(priv->stats.bus_hist, begin, perf_gettime());
 }
 
 /****************************************************************************
- * Name: bme280_reg_write
+ * Name: bme280_stats_wait
  *
  * Description:
- *   Write to an 8-bit BME280 register
+ *   Record the wait for a measurement (from Zephyr BME280 Driver), from
+ *   start until the read that found the sensor ready, with the number of
+ *   sleeps
  *
  ****************************************************************************/
 
-static int bme280_reg_write(const struct device *priv, uint8_t reg,
-    uint8_t val)
+static void bme280_stats_wait(FAR struct device *priv, uint64_t start,
+                              uint64_t ready, uint32_t waits)
 {
-  DEBUGASSERT(priv != NULL);
-  sninfo("reg=0x%02x, val=0x%02x\n", reg, val);
-  struct i2c_msg_s msg[2];
-  uint8_t txbuffer[2];
-  uint8_t rxbuffer[1];
-  int ret;
+  priv->stats.waits += waits;
+  bme280_stats_hist(priv->stats.wait_hist, start, ready);
+}
 
-  txbuffer[0] = reg;
-  txbuffer[1] = val;
+/****************************************************************************
+ * Name: bme280_stats_compensate
+ *
+ * Description:
+ *   Record the compensation of a sample (from Zephyr BME280 Driver), since
+ *   start
+ *
+ ****************************************************************************/
 
-  msg[0].frequency = priv->freq;
-  msg[0].addr      = priv->addr;
-#ifdef CONFIG_BL602_I2C0
-  //  For BL602: Register ID and value must be passed as I2C Sub Address
-  msg[0].flags     = I2C_M_NOSTOP;
-#else
-  //  Otherwise pass Register ID and value as I2C Data
-  msg[0].flags     = 0;
-#endif  //  CONFIG_BL602_I2C0
-  msg[0].buffer    = txbuffer;
-  msg[0].length    = 2;
+static void bme280_stats_compensate(FAR struct device *priv,
+                                    uint64_t start)
+{
+  priv->stats.samples++;
+  bme280_stats_hist(priv->stats.comp_hist, start, perf_gettime());
+}
 
-  //  For BL602: We read I2C Data because this forces BL602 to send the first message correctly
-  msg[1].frequency = priv->freq;
-  msg[1].addr      = priv->addr;
-  msg[1].flags     = I2C_M_READ;
-  msg[1].buffer    = rxbuffer;
-  msg[1].length    = sizeof(rxbuffer);
+/****************************************************************************
+ * Name: bme280_get_stats
+ *
+ * Description:
+ *   Copy the performance counters, with the counters of the sample cache
+ *   and the temperature memo
+ *
+ ****************************************************************************/
 
-  ret = I2C_TRANSFER(priv->i2c, msg, 2);
-  if (ret < 0)
+static int bme280_get_stats(FAR struct device *priv,
+                            FAR struct bme280_stats_s *stats)
+{
+  if (stats == NULL)
     {
-      snerr("I2C_TRANSFER failed: %d\n", ret);
+      return -EINVAL;
     }
 
-  return ret;
+  memcpy(stats, &priv->stats, sizeof(*stats));
+  stats->cache_hits   = priv->cache_hits;
+  stats->cache_misses = priv->cache_misses;
+  stats->memo_hits    = priv->data->memo_hits;
+  stats->memo_misses  = priv->data->memo_misses;
+  return OK;
 }
 
 /****************************************************************************
- * Name: bme280_set_standby
+ * Name: bme280_reset_stats
  *
  * Description:
- *   Set Standby Duration. Zephyr assumes that Standby Duration is static,
- *   so we set it in NuttX.
+ *   Clear the performance counters, including the sample cache and the
+ *   temperature memo
  *
  ****************************************************************************/
 
-static int bme280_set_standby(FAR struct device *priv, uint8_t value)
+static void bme280_reset_stats(FAR struct device *priv)
 {
-  DEBUGASSERT(priv != NULL);
-  sninfo("value=%d\n", value);
-  
-  uint8_t v_data_u8;
-  uint8_t v_sb_u8;
-  int ret;
+  memset(&priv->stats, 0, sizeof(priv->stats));
+  priv->cache_hits = 0;
+  priv->cache_misses = 0;
+  priv->data->memo_hits = 0;
+  priv->data->memo_misses = 0;
+}
+#endif /* CONFIG_BME280_STATS */
 
-  /* Set the standby duration value */
+#if defined(CONFIG_BME280_TRACE) || defined(CONFIG_BME280_RECORD)
+/****************************************************************************
+ * Name: bme280_ring_read
+ *
+ * Description:
+ *   Copy up to max entries of size bytes from a ring of nring entries,
+ *   recorded since the last read, oldest first.  Writers claim an entry by
+ *   incrementing head.  Entries overwritten before or while they are
+ *   copied are counted in dropped.  Returns the number of entries copied.
+ *
+ ****************************************************************************/
 
-  ret = bme280_reg_read(priv, BME280_REG_CONFIG, &v_data_u8, 1);
-  if (ret < 0)
+static uint32_t bme280_ring_read(FAR void *dst, FAR const void *ring,
+                                 size_t size, uint32_t nring,
+                                 FAR atomic_uint *head,
+                                 FAR uint32_t *tail, uint32_t max,
+                                 FAR uint32_t *dropped)
+{
+  FAR uint8_t *out = dst;
+  FAR const uint8_t *in = ring;
+  uint32_t newest;
+  uint32_t skip;
+  uint32_t n;
+  uint32_t i;
+
+  /* Skip the entries already overwritten */
+
+  *dropped = 0;
+  newest = atomic_load(head);
+  if (newest - *tail > nring)
     {
-      return ret;
+      *dropped = newest - *tail - nring;
+      *tail = newest - nring;
     }
-  v_data_u8 = (v_data_u8 & ~(0x07 << 5)) | (value << 5);
-  ret = bme280_reg_write(priv, BME280_REG_CONFIG, v_data_u8);
-  if (ret < 0)
+
+  n = newest - *tail;
+  if (n > max)
     {
-      return ret;
+      n = max;
     }
 
-  /* Check the standby duration value */
-
-  ret = bme280_reg_read(priv, BME280_REG_CONFIG, &v_data_u8, 1);
-  if (ret < 0)
+  for (i = 0; i < n; i++)
     {
-      return ret;
+      memcpy(out + i * size, in + ((*tail + i) & (nring - 1)) * size,
+             size);
     }
-  v_sb_u8 = (v_data_u8 >> 5) & 0x07;
 
-  if (v_sb_u8 != value)
+  /* Drop the oldest entries copied if they were overwritten meanwhile */
+
+  newest = atomic_load(head);
+  skip = 0;
+  if (newest - *tail > nring)
     {
-      snerr("Failed to set value for standby time.");
-      return ERROR;
+      skip = newest - *tail - nring;
+      if (skip > n)
+        {
+          skip = n;
+        }
+
+      memmove(out, out + skip * size, (n - skip) * size);
     }
 
-  return OK;
+  *tail += n;
+  *dropped += skip;
+  return n - skip;
 }
+#endif
+
+#ifdef CONFIG_BME280_RECORD
+#  if BME280_RECORD_NVM_SIZE != BME280_NVM_SIZE || \
+      BME280_RECORD_RAW_SIZE != BME280_RAW_SIZE
+#    error "record.h sizes do not match compensate.h"
+#  endif
 
 /****************************************************************************
- * Name: bme280_set_interval
+ * Name: bme280_record_frame
  *
  * Description:
- *   Set Standby Interval for the device
+ *   Record the raw data burst of a measurement (from Zephyr BME280 Driver).
+ *   Humidity is zero on BMP280.
  *
  ****************************************************************************/
 
-static int bme280_set_interval(FAR struct device *priv,
-                               FAR unsigned long *period_us)
+static void bme280_record_frame(FAR struct device *priv,
+                                FAR const uint8_t *raw)
 {
-  DEBUGASSERT(priv != NULL);
-  DEBUGASSERT(period_us != NULL);
-  int ret = 0;
+  FAR struct bme280_frame_s *frame;
+  unsigned int head;
 
-  uint8_t regval;
+  head  = atomic_fetch_add(&priv->record_head, 1);
+  frame = &priv->record[head & (CONFIG_BME280_RECORD_SIZE - 1)];
+  frame->timestamp = (uint32_t)bme280_now();
+  memcpy(frame->raw, raw, BME280_RECORD_RAW_SIZE);
+}
 
-  switch (*period_us)
-    {
-      case 500:
-        regval = BME280_STANDBY_05_MS;
-        break;
-      case 62500:
-        regval = BME280_STANDBY_63_MS;
-        break;
-      case 125000:
-        regval = BME280_STANDBY_125_MS;
-        break;
-      case 250000:
-        regval = BME280_STANDBY_250_MS;
-        break;
-      case 500000:
-        regval = BME280_STANDBY_500_MS;
-        break;
-      case 1000000:
-        regval = BME280_STANDBY_1000_MS;
-        break;
-      case 2000000:
-        regval = BME280_STANDBY_2000_MS;
-        break;
-      case 4000000:
-        regval = BME280_STANDBY_4000_MS;
-        break;
-      default:
-        ret = -EINVAL;
-        break;
-    }
+/****************************************************************************
+ * Name: bme280_get_record
+ *
+ * Description:
+ *   Copy the recording header, and the raw frames recorded since the last
+ *   call, oldest first
+ *
+ ****************************************************************************/
 
-  if (ret == 0)
+static int bme280_get_record(FAR struct device *priv,
+                             FAR struct bme280_recordbuf_s *buf)
+{
+  if (buf == NULL || buf->frames == NULL)
     {
-      ret = bme280_set_standby(priv, regval);
+      return -EINVAL;
     }
 
-  return ret;
+  memset(&buf->header, 0, sizeof(buf->header));
+  memcpy(buf->header.magic, BME280_RECORD_MAGIC,
+         BME280_RECORD_MAGIC_SIZE);
+  buf->header.chip_id = priv->data->chip_id;
+  memcpy(buf->header.nvm, priv->data->nvm, BME280_RECORD_NVM_SIZE);
+
+  buf->nframes = bme280_ring_read(buf->frames, priv->record,
+                                  sizeof(struct bme280_frame_s),
+                                  CONFIG_BME280_RECORD_SIZE,
+                                  &priv->record_head, &priv->record_tail,
+                                  buf->nframes, &buf->dropped);
+  return OK;
 }
+#endif /* CONFIG_BME280_RECORD */
 
+#ifdef CONFIG_BME280_TRACE
 /****************************************************************************
- * Name: bme280_set_interval_baro
+ * Name: bme280_trace
  *
  * Description:
- *   Call by NuttX to set Standby Interval for Barometer Sensor
+ *   Record a trace event.  The slot is claimed with an atomic increment,
+ *   so the worker and the callers may record without locking.
  *
  ****************************************************************************/
 
-static int bme280_set_interval_baro(FAR struct sensor_lowerhalf_s *lower,
-                               FAR struct file *filep,
-                               FAR unsigned long *period_us)
+static void bme280_trace(FAR struct device *priv, uint8_t event,
+                         uint8_t reg, uint8_t len, int result)
 {
-  DEBUGASSERT(lower != NULL);
-  DEBUGASSERT(period_us != NULL);
-  sninfo("period_us=%lu\n", *period_us);
-
-  /* Get device struct */
+  FAR struct bme280_trace_s *trace;
+  unsigned int head;
+
+  head  = atomic_fetch_add(&priv->trace_head, 1);
+  trace = &priv->trace[head & BME280_TRACE_MASK];
+  trace->timestamp = (uint32_t)bme280_now();
+  trace->event     = event;
+  trace->reg       = reg;
+  trace->len       = len;
+  trace->result    = (result >= 0) ? 0 : (result < -128) ? -128 : result;
+}
 
-  FAR struct device *priv = container_of(lower,
-                                               FAR struct device,
-                                               sensor_baro);
-  sninfo("priv=%p, sensor_baro=%p\n", priv, lower); ////
+/****************************************************************************
+ * Name: bme280_get_trace
+ *
+ * Description:
+ *   Copy the trace events recorded since the last call, oldest first
+ *
+ ****************************************************************************/
 
-  /* Set the standby interval */
+static int bme280_get_trace(FAR struct device *priv,
+                            FAR struct bme280_tracebuf_s *buf)
+{
+  if (buf == NULL || buf->events == NULL)
+    {
+      return -EINVAL;
+    }
 
-  return bme280_set_interval(priv, period_us);
+  buf->nevents = bme280_ring_read(buf->events, priv->trace,
+                                  sizeof(struct bme280_trace_s),
+                                  CONFIG_BME280_TRACE_SIZE,
+                                  &priv->trace_head, &priv->trace_tail,
+                                  buf->nevents, &buf->dropped);
+  return OK;
 }
+#endif /* CONFIG_BME280_TRACE */
 
 /****************************************************************************
- * Name: bme280_set_interval_humi
+ * Name: bme280_convert
  *
  * Description:
- *   Called by NuttX to set Standby Interval for Humidity Sensor
+ *   Convert the compensated values (from Zephyr BME280 Driver) to the
+ *   published units with one multiply each: comp_temp is in 0.01 degC,
+ *   comp_press is in Pa with 8 fractional bits (1/25600 hPa) and
+ *   comp_humidity is in %RH with 10 fractional bits.  With
+ *   CONFIG_BME280_FLOAT_COMPENSATION, the compensated values are already
+ *   in degC, Pa and %RH.
  *
  ****************************************************************************/
 
-static int bme280_set_interval_humi(FAR struct sensor_lowerhalf_s *lower,
+static void bme280_convert(FAR const struct bme280_data *data,
+                           FAR struct sensor_baro *baro,
+                           FAR struct sensor_humi *humi)
+{
+  DEBUGASSERT(data != NULL && baro != NULL && humi != NULL);
+
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+  baro->pressure    = data->pressure * 0.01f;
+  baro->temperature = data->temperature;
+  humi->humidity    = data->humidity;
+#else
+  baro->pressure    = bme280_press_hpa(data->comp_press);
+  baro->temperature = bme280_temp_degc(data->comp_temp);
+  humi->humidity    = bme280_humidity_rh(data->comp_humidity);
+#endif
+}
+
+/****************************************************************************
+ * Name: pm_device_state_get
+ *
+ * Description:
+ *   Get the device state (active / suspended)
+ *
+ ****************************************************************************/
+
+static int pm_device_state_get(const struct device *priv,
+  enum pm_device_state *state)
+{
+  DEBUGASSERT(priv != NULL);
+  DEBUGASSERT(state != NULL);
+  if (priv->activated)
+    {
+      *state = PM_DEVICE_STATE_ACTIVE;
+    }
+  else
+    {
+      *state = PM_DEVICE_STATE_SUSPENDED;
+    }
+  return 0;  
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_check
+ *
+ * Description:
+ *   Check I2C Bus
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_check(FAR const union bme280_bus *bus)
+{
+  DEBUGASSERT(bus != NULL);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_read
+ *
+ * Description:
+ *   Read from 8-bit BME280 registers over I2C
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_read(FAR const union bme280_bus *bus,
+    uint8_t start, uint8_t *buf, int size)
+{
+  DEBUGASSERT(bus != NULL);
+  DEBUGASSERT(buf != NULL);
+  struct i2c_msg_s msg[2];
+  int ret;
+
+  msg[0].frequency = bus->i2c.freq;
+  msg[0].addr      = bus->i2c.addr;
+#ifdef CONFIG_BL602_I2C0
+  //  For BL602: Register ID must be passed as I2C Sub Address
+  msg[0].flags     = I2C_M_NOSTOP;
+#else
+  //  Otherwise pass Register ID as I2C Data
+  msg[0].flags     = 0;
+#endif  //  CONFIG_BL602_I2C0
+  msg[0].buffer    = &start;
+  msg[0].length    = 1;
+
+  msg[1].frequency = bus->i2c.freq;
+  msg[1].addr      = bus->i2c.addr;
+  msg[1].flags     = I2C_M_READ;
+  msg[1].buffer    = buf;
+  msg[1].length    = size;
+
+  ret = I2C_TRANSFER(bus->i2c.bus, msg, 2);
+  if (ret < 0)
+    {
+      sninfo("start=0x%02x, size=%d\n", start, size);
+      snerr("I2C_TRANSFER failed: %d\n", ret);
+      return ret;
+    }
+
+  if (size == 1)
+    {
+      bme280_info("start=0x%02x, size=%d, buf[0]=0x%02x\n", start, size,
+                  buf[0]);
+    }
+  else
+    {
+      bme280_info("start=0x%02x, size=%d\n", start, size);
+    }
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_send
+ *
+ * Description:
+ *   Send pairs of Register ID and value to BME280 in one I2C message
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_send(FAR const union bme280_bus *bus,
+    FAR uint8_t *txbuffer, int length)
+{
+  DEBUGASSERT(bus != NULL);
+  DEBUGASSERT(txbuffer != NULL);
+  struct i2c_msg_s msg[2];
+  int nmsgs = 1;
+  int ret;
+
+  msg[0].frequency = bus->i2c.freq;
+  msg[0].addr      = bus->i2c.addr;
+#ifdef CONFIG_BL602_I2C0
+  //  For BL602: Register ID and value must be passed as I2C Sub Address
+  msg[0].flags     = I2C_M_NOSTOP;
+#else
+  //  Otherwise pass Register ID and value as I2C Data
+  msg[0].flags     = 0;
+#endif  //  CONFIG_BL602_I2C0
+  msg[0].buffer    = txbuffer;
+  msg[0].length    = length;
+
+#ifdef CONFIG_BL602_I2C0
+  //  For BL602: We read I2C Data because this forces BL602 to send the first message correctly
+  uint8_t rxbuffer[1];
+
+  msg[1].frequency = bus->i2c.freq;
+  msg[1].addr      = bus->i2c.addr;
+  msg[1].flags     = I2C_M_READ;
+  msg[1].buffer    = rxbuffer;
+  msg[1].length    = sizeof(rxbuffer);
+  nmsgs = 2;
+#endif  //  CONFIG_BL602_I2C0
+
+  ret = I2C_TRANSFER(bus->i2c.bus, msg, nmsgs);
+  if (ret < 0)
+    {
+      snerr("I2C_TRANSFER failed: %d\n", ret);
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_write
+ *
+ * Description:
+ *   Write to an 8-bit BME280 register over I2C
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_write(FAR const union bme280_bus *bus, uint8_t reg,
+    uint8_t val)
+{
+  DEBUGASSERT(bus != NULL);
+  bme280_info("reg=0x%02x, val=0x%02x\n", reg, val);
+  uint8_t txbuffer[2];
+
+  txbuffer[0] = reg;
+  txbuffer[1] = val;
+
+  return bme280_i2c_send(bus, txbuffer, sizeof(txbuffer));
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_write_multi
+ *
+ * Description:
+ *   Write to multiple 8-bit BME280 registers over I2C.  pairs contains
+ *   count pairs of Register ID and value, which are sent in a single I2C
+ *   message.
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_write_multi(FAR const union bme280_bus *bus,
+    const uint8_t *pairs, int count)
+{
+  DEBUGASSERT(bus != NULL);
+  DEBUGASSERT(pairs != NULL);
+  bme280_info("reg=0x%02x, count=%d\n", pairs[0], count);
+
+#ifdef CONFIG_BL602_I2C0
+  //  For BL602: I2C Sub Address is limited to a few bytes,
+  //  so we write one register at a time
+  int ret = OK;
+  int i;
+
+  for (i = 0; i < count && ret >= 0; i++)
+    {
+      ret = bme280_i2c_write(bus, pairs[2 * i], pairs[2 * i + 1]);
+    }
+
+  return ret;
+#else
+  return bme280_i2c_send(bus, (FAR uint8_t *)pairs, 2 * count);
+#endif  //  CONFIG_BL602_I2C0
+}
+
+#ifdef CONFIG_BME280_I2C_PROBE
+/****************************************************************************
+ * Name: bme280_i2c_probe_read
+ *
+ * Description:
+ *   Read the Chip ID and the Calibration NVM at 0x88 at the current I2C
+ *   frequency, for comparison between frequencies
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_probe_read(FAR struct device *priv, FAR uint8_t *buf)
+{
+  int ret;
+
+  ret = bme280_i2c_read(&priv->bus, BME280_REG_ID, buf, 1);
+  if (ret >= 0)
+    {
+      ret = bme280_i2c_read(&priv->bus, BME280_REG_COMP_START, &buf[1],
+                            BME280_PROBE_NVM_LEN);
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_probe
+ *
+ * Description:
+ *   Find the fastest I2C frequency, up to the current frequency, at which
+ *   the Chip ID and the Calibration NVM read the same as at Standard-mode.
+ *   The frequency is raised one step at a time, and the last good one is
+ *   kept.
+ *
+ ****************************************************************************/
+
+static int bme280_i2c_probe(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL && priv->bus_io == &bme280_bus_io_i2c);
+  uint8_t ref[1 + BME280_PROBE_NVM_LEN];
+  uint8_t buf[1 + BME280_PROBE_NVM_LEN];
+  uint32_t freq_max = priv->bus.i2c.freq;
+  int ret;
+  int i;
+
+  if (freq_max <= g_bme280_i2c_speeds[0])
+    {
+      return OK;
+    }
+
+  priv->bus.i2c.freq = g_bme280_i2c_speeds[0];
+  ret = bme280_i2c_probe_read(priv, ref);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  for (i = 1; i < BME280_I2C_NSPEEDS; i++)
+    {
+      if (g_bme280_i2c_speeds[i] > freq_max)
+        {
+          break;
+        }
+
+      priv->bus.i2c.freq = g_bme280_i2c_speeds[i];
+      ret = bme280_i2c_probe_read(priv, buf);
+      if (ret < 0 || memcmp(buf, ref, sizeof(ref)) != 0)
+        {
+          priv->bus.i2c.freq = g_bme280_i2c_speeds[i - 1];
+          break;
+        }
+    }
+
+  sninfo("freq=%" PRIu32 "\n", priv->bus.i2c.freq);
+  priv->freq_probed = priv->bus.i2c.freq;
+  priv->fallback_us = 0;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_fallback
+ *
+ * Description:
+ *   After a transfer failed with a bus error (-EIO or -EPROTO), step the
+ *   I2C frequency down to the next slower speed.  Returns true if the
+ *   transfer should be retried.  A missing or busy sensor (-ENXIO,
+ *   -ETIMEDOUT) fails at any speed, so it does not slow down the bus.
+ *
+ ****************************************************************************/
+
+static bool bme280_i2c_fallback(FAR struct device *priv, int ret)
+{
+  int i;
+
+  if ((ret != -EIO && ret != -EPROTO) ||
+      priv->bus_io != &bme280_bus_io_i2c)
+    {
+      return false;
+    }
+
+  for (i = BME280_I2C_NSPEEDS - 1; i >= 0; i--)
+    {
+      if (g_bme280_i2c_speeds[i] < priv->bus.i2c.freq)
+        {
+          snwarn("I2C transfer failed, falling back to %" PRIu32 " Hz\n",
+                 g_bme280_i2c_speeds[i]);
+          priv->bus.i2c.freq = g_bme280_i2c_speeds[i];
+          priv->freq_fallbacks++;
+          priv->fallback_us = bme280_now();
+#ifdef CONFIG_BME280_STATS
+          priv->stats.retries++;
+#endif
+          return true;
+        }
+    }
+
+  return false;
+}
+
+/****************************************************************************
+ * Name: bme280_i2c_reprobe
+ *
+ * Description:
+ *   Probe the I2C frequency again, up to the probed frequency, once
+ *   CONFIG_BME280_I2C_REPROBE_USEC passed since the last step down.  So a
+ *   bus that was disturbed for a while speeds up again.
+ *
+ ****************************************************************************/
+
+static void bme280_i2c_reprobe(FAR struct device *priv)
+{
+  uint32_t freq_probed = priv->freq_probed;
+
+  if (priv->fallback_us == 0 ||
+      bme280_now() - priv->fallback_us < CONFIG_BME280_I2C_REPROBE_USEC)
+    {
+      return;
+    }
+
+  priv->bus.i2c.freq = freq_probed;
+  bme280_i2c_probe(priv);
+
+  /* Keep the probed frequency as the limit, and probe again later if
+   * the bus is still slower
+   */
+
+  priv->freq_probed = freq_probed;
+  if (priv->bus.i2c.freq < freq_probed)
+    {
+      priv->fallback_us = bme280_now();
+    }
+}
+#endif /* CONFIG_BME280_I2C_PROBE */
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_spi_transfer
+ *
+ * Description:
+ *   Send txbuffer to BME280 and receive rxbuffer (if any) with Chip Select
+ *   asserted.  The SPI Bus is locked and configured for each transfer,
+ *   since other devices may share it.
+ *
+ ****************************************************************************/
+
+static void bme280_spi_transfer(FAR const struct spi_dt_spec *spi,
+                                FAR const uint8_t *txbuffer, int txlength,
+                                FAR uint8_t *rxbuffer, int rxlength)
+{
+  DEBUGASSERT(spi != NULL && spi->bus != NULL);
+
+  SPI_LOCK(spi->bus, true);
+  SPI_SETFREQUENCY(spi->bus, spi->freq);
+  SPI_SETMODE(spi->bus, BME280_SPI_MODE);
+  SPI_SETBITS(spi->bus, 8);
+  SPI_SELECT(spi->bus, spi->devid, true);
+
+  SPI_SNDBLOCK(spi->bus, txbuffer, txlength);
+  if (rxlength > 0)
+    {
+      SPI_RECVBLOCK(spi->bus, rxbuffer, rxlength);
+    }
+
+  SPI_SELECT(spi->bus, spi->devid, false);
+  SPI_LOCK(spi->bus, false);
+}
+
+/****************************************************************************
+ * Name: bme280_spi_check
+ *
+ * Description:
+ *   Check SPI Bus.  BME280 starts in 4-wire mode, so 3-wire mode is
+ *   enabled before the first read.  Writes work in both modes.
+ *
+ ****************************************************************************/
+
+static int bme280_spi_check(FAR const union bme280_bus *bus)
+{
+  DEBUGASSERT(bus != NULL);
+  uint8_t txbuffer[2];
+
+  if (bus->spi.three_wire)
+    {
+      txbuffer[0] = BME280_REG_CONFIG & ~BME280_SPI_READ;
+      txbuffer[1] = BME280_SPI_3W_ENABLE;
+      bme280_spi_transfer(&bus->spi, txbuffer, sizeof(txbuffer), NULL, 0);
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_spi_read
+ *
+ * Description:
+ *   Read from 8-bit BME280 registers over SPI.  The Register ID is sent
+ *   with bit 7 set, then the registers are read with auto-increment.
+ *
+ ****************************************************************************/
+
+static int bme280_spi_read(FAR const union bme280_bus *bus,
+                           uint8_t start, uint8_t *buf, int size)
+{
+  DEBUGASSERT(bus != NULL);
+  DEBUGASSERT(buf != NULL);
+  bme280_info("start=0x%02x, size=%d\n", start, size);
+  uint8_t cmd = start | BME280_SPI_READ;
+
+  bme280_spi_transfer(&bus->spi, &cmd, 1, buf, size);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_spi_write_multi
+ *
+ * Description:
+ *   Write to multiple 8-bit BME280 registers over SPI.  pairs contains
+ *   count pairs of Register ID and value, which are sent with bit 7 of
+ *   the Register ID cleared while Chip Select stays asserted.
+ *
+ ****************************************************************************/
+
+static int bme280_spi_write_multi(FAR const union bme280_bus *bus,
+                                  const uint8_t *pairs, int count)
+{
+  DEBUGASSERT(bus != NULL);
+  DEBUGASSERT(pairs != NULL);
+  DEBUGASSERT(count > 0 && count <= BME280_SPI_WRITE_MAX);
+  bme280_info("reg=0x%02x, count=%d\n", pairs[0], count);
+  uint8_t txbuffer[2 * BME280_SPI_WRITE_MAX];
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      txbuffer[2 * i]     = pairs[2 * i] & ~BME280_SPI_READ;
+      txbuffer[2 * i + 1] = pairs[2 * i + 1];
+    }
+
+  bme280_spi_transfer(&bus->spi, txbuffer, 2 * count, NULL, 0);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_spi_write
+ *
+ * Description:
+ *   Write to an 8-bit BME280 register over SPI
+ *
+ ****************************************************************************/
+
+static int bme280_spi_write(FAR const union bme280_bus *bus, uint8_t reg,
+                            uint8_t val)
+{
+  uint8_t pair[2];
+
+  pair[0] = reg;
+  pair[1] = val;
+
+  return bme280_spi_write_multi(bus, pair, 1);
+}
+#endif /* CONFIG_SPI */
+
+/****************************************************************************
+ * Name: bme280_bus_check
+ *
+ * Description:
+ *   Check I2C or SPI Bus
+ *
+ ****************************************************************************/
+
+static int bme280_bus_check(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  return priv->bus_io->check(&priv->bus);
+}
+
+/****************************************************************************
+ * Name: bme280_reg_read
+ *
+ * Description:
+ *   Read from 8-bit BME280 registers
+ *
+ ****************************************************************************/
+
+static int bme280_reg_read(FAR struct device *priv,
+    uint8_t start, uint8_t *buf, int size)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t begin;
+  int ret;
+
+  do
+    {
+      begin = bme280_stats_time();
+      ret = priv->bus_io->read(&priv->bus, start, buf, size);
+      bme280_stats_bus(priv, begin, 1 + size, ret);
+      bme280_trace(priv, BME280_TRACE_READ, start, size, ret);
+    }
+  while (bme280_i2c_fallback(priv, ret));
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_reg_write
+ *
+ * Description:
+ *   Write to an 8-bit BME280 register
+ *
+ ****************************************************************************/
+
+static int bme280_reg_write(FAR struct device *priv, uint8_t reg,
+    uint8_t val)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t begin;
+  int ret;
+
+  do
+    {
+      begin = bme280_stats_time();
+      ret = priv->bus_io->write(&priv->bus, reg, val);
+      bme280_stats_bus(priv, begin, 2, ret);
+      bme280_trace(priv, BME280_TRACE_WRITE, reg, 1, ret);
+    }
+  while (bme280_i2c_fallback(priv, ret));
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_reg_write_multi
+ *
+ * Description:
+ *   Write to multiple 8-bit BME280 registers.  pairs contains count pairs
+ *   of Register ID and value, which are sent in a single transfer.
+ *
+ ****************************************************************************/
+
+static int bme280_reg_write_multi(FAR struct device *priv,
+    const uint8_t *pairs, int count)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t begin;
+  int ret;
+
+  do
+    {
+      begin = bme280_stats_time();
+      ret = priv->bus_io->write_multi(&priv->bus, pairs, count);
+      bme280_stats_bus(priv, begin, 2 * count, ret);
+      bme280_trace(priv, BME280_TRACE_WRITE_MULTI, pairs[0], count, ret);
+    }
+  while (bme280_i2c_fallback(priv, ret));
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_set_standby
+ *
+ * Description:
+ *   Set Standby Duration. Zephyr assumes that Standby Duration is static,
+ *   so we set it in NuttX.  CONFIG is written only if it changed, and
+ *   read back only with CONFIG_BME280_VERIFY_CTRL.
+ *
+ ****************************************************************************/
+
+static int bme280_set_standby(FAR struct device *priv, uint8_t value)
+{
+  DEBUGASSERT(priv != NULL);
+  sninfo("value=%d\n", value);
+  FAR struct bme280_data *data = priv->data;
+  uint8_t config;
+
+  /* Set the standby duration value */
+
+  config = (data->config & ~BME280_STANDBY_MASK) | (value << 5);
+  return bme280_chip_reconfigure(priv, data->ctrl_hum, data->ctrl_meas,
+                                 config);
+}
+
+#ifdef CONFIG_BME280_PUSH_MODE
+/****************************************************************************
+ * Name: bme280_set_batch
+ *
+ * Description:
+ *   Set the batch latency for the device.  The worker pushes a batch once
+ *   the oldest pending sample is latency_us old, so each batch holds
+ *   latency_us / interval + 1 samples, limited by the ring buffer.  The
+ *   effective latency is returned in latency_us.
+ *
+ ****************************************************************************/
+
+static void bme280_set_batch(FAR struct device *priv,
+                             FAR unsigned long *latency_us)
+{
+  DEBUGASSERT(priv != NULL);
+  DEBUGASSERT(latency_us != NULL);
+  unsigned long size;
+
+  size = *latency_us / priv->interval_us + 1;
+  if (size > CONFIG_BME280_RING_SIZE)
+    {
+      size = CONFIG_BME280_RING_SIZE;
+    }
+
+  priv->batch_size = size;
+  priv->latency_us = (size - 1) * priv->interval_us;
+  *latency_us      = priv->latency_us;
+  sninfo("batch_size=%u, latency_us=%lu\n", priv->batch_size,
+         priv->latency_us);
+}
+#endif
+
+/****************************************************************************
+ * Name: bme280_select_standby
+ *
+ * Description:
+ *   Select the Standby Duration for a sampling interval, given the
+ *   oversampling in CTRL_MEAS and CTRL_HUM.  In Normal Mode the sensor
+ *   measures every t_meas + t_sb, so we pick the longest such period that
+ *   fits in the interval: every sample taken once per interval is then a
+ *   new measurement, with the fewest measurements in between.  Intervals
+ *   shorter than the fastest period are raised to it, and the effective
+ *   interval is returned in period_us.
+ *
+ ****************************************************************************/
+
+static uint8_t bme280_select_standby(FAR struct device *priv,
+                                     uint8_t ctrl_meas, uint8_t ctrl_hum,
+                                     FAR unsigned long *period_us)
+{
+  DEBUGASSERT(priv != NULL);
+  DEBUGASSERT(period_us != NULL);
+  FAR const uint32_t *t_sb = g_bmp280_standby_us;
+  uint32_t t_meas = bme280_meas_time_us(ctrl_meas, ctrl_hum);
+  uint8_t regval = BME280_STANDBY_05_MS;
+  uint8_t i;
+
+  /* Codes 6 and 7 are 10 ms and 20 ms on BME280 */
+
+  if (priv->data->chip_id == BME280_CHIP_ID)
+    {
+      t_sb = g_bme280_standby_us;
+    }
+
+  /* 0.5 ms is the shortest standby on both chips */
+
+  for (i = 1; i < 8; i++)
+    {
+      if (t_meas + t_sb[i] <= *period_us && t_sb[i] > t_sb[regval])
+        {
+          regval = i;
+        }
+    }
+
+  if (*period_us < t_meas + t_sb[regval])
+    {
+      *period_us = t_meas + t_sb[regval];
+    }
+
+#ifdef CONFIG_BME280_WORKER
+  /* The worker samples on whole system ticks */
+
+  *period_us = TICK2USEC((*period_us + USEC_PER_TICK - 1) / USEC_PER_TICK);
+#endif
+
+  sninfo("t_meas=%" PRIu32 ", t_sb=%" PRIu32 ", period_us=%lu\n",
+         t_meas, t_sb[regval], *period_us);
+  return regval;
+}
+
+/****************************************************************************
+ * Name: bme280_set_interval
+ *
+ * Description:
+ *   Set the sampling interval for the device.  Any interval is accepted:
+ *   the Standby Duration is chosen for it, and the effective interval is
+ *   returned in period_us.
+ *
+ ****************************************************************************/
+
+static int bme280_set_interval(FAR struct device *priv,
+                               FAR unsigned long *period_us)
+{
+  DEBUGASSERT(priv != NULL);
+  DEBUGASSERT(period_us != NULL);
+  FAR struct bme280_data *data = priv->data;
+  unsigned long request_us = *period_us;
+  uint8_t regval;
+  int ret;
+
+  if (*period_us == 0)
+    {
+      return -EINVAL;
+    }
+
+#ifdef CONFIG_BME280_DUAL
+  /* In Dual Mode, each sensor measures at twice the interval */
+
+  if (priv->peer != NULL)
+    {
+      *period_us *= 2;
+    }
+#endif
+
+  regval = bme280_select_standby(priv, data->ctrl_meas, data->ctrl_hum,
+                                 period_us);
+  ret = bme280_set_standby(priv, regval);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  priv->request_us = request_us;
+
+#ifdef CONFIG_BME280_WORKER
+  priv->interval_us = *period_us;
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+  /* Restart the sensors half a period apart */
+
+  if (priv->peer != NULL)
+    {
+      ret = bme280_dual_restart(priv);
+      *period_us = priv->interval_us;
+    }
+#endif
+
+#ifdef CONFIG_BME280_PUSH_MODE
+  /* Keep the batch latency for the new interval */
+
+  bme280_set_batch(priv, &priv->latency_us);
+#endif
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_set_interval_baro
+ *
+ * Description:
+ *   Call by NuttX to set Standby Interval for Barometer Sensor
+ *
+ ****************************************************************************/
+
+static int bme280_set_interval_baro(FAR struct sensor_lowerhalf_s *lower,
+                               FAR struct file *filep,
+                               FAR unsigned long *period_us)
+{
+  DEBUGASSERT(lower != NULL);
+  DEBUGASSERT(period_us != NULL);
+  sninfo("period_us=%lu\n", *period_us);
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_baro);
+  int ret;
+  sninfo("priv=%p, sensor_baro=%p\n", priv, lower); ////
+
+  /* Set the standby interval */
+
+  bme280_lock(priv);
+  ret = bme280_set_interval(priv, period_us);
+  bme280_unlock(priv);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_set_interval_humi
+ *
+ * Description:
+ *   Called by NuttX to set Standby Interval for Humidity Sensor
+ *
+ ****************************************************************************/
+
+static int bme280_set_interval_humi(FAR struct sensor_lowerhalf_s *lower,
                                FAR struct file *filep,
                                FAR unsigned long *period_us)
 {
   DEBUGASSERT(lower != NULL);
-  DEBUGASSERT(period_us != NULL);
-  sninfo("period_us=%lu\n", *period_us);
+  DEBUGASSERT(period_us != NULL);
+  sninfo("period_us=%lu\n", *period_us);
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_humi);
+  int ret;
+  sninfo("priv=%p, sensor_humi=%p\n", priv, lower); ////
+
+  /* Set the standby interval */
+
+  bme280_lock(priv);
+  ret = bme280_set_interval(priv, period_us);
+  bme280_unlock(priv);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_activate
+ *
+ * Description:
+ *   Set Power Mode for the device. If enable is true, set Power Mode 
+ *   to normal. Else set to sleep mode.
+ *
+ ****************************************************************************/
+
+static int bme280_activate(FAR struct device *priv,
+                           bool enable)
+{
+  DEBUGASSERT(priv != NULL);
+  int ret = 0;
+
+  if (enable)
+    {
+      /* Set power mode to normal */
+
+      ret = bme280_pm_action(priv, PM_DEVICE_ACTION_RESUME);
+    }
+  else
+    {
+      /* Set to sleep mode */
+
+      ret = bme280_pm_action(priv, PM_DEVICE_ACTION_SUSPEND);
+    }
+
+  if (ret >= 0)
+    {
+      priv->activated = enable;
+      priv->cached = false;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_activate_baro
+ *
+ * Description:
+ *   Set Power Mode for Barometer Sensor. If enable is true, set Power Mode 
+ *   to normal. Else set to sleep mode.
+ *
+ ****************************************************************************/
+
+static int bme280_activate_baro(FAR struct sensor_lowerhalf_s *lower,
+                           FAR struct file *filep,
+                           bool enable)
+{
+  DEBUGASSERT(lower != NULL);
+  bme280_info("enable=%d\n", enable);
+  int ret;
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_baro);
+  bme280_info("priv=%p, sensor_baro=%p\n", priv, lower); ////
+
+  /* Set the power mode */
+
+  ret = bme280_enable(priv, enable);
+  bme280_trace(priv, BME280_TRACE_ACTIVATE, BME280_TRACE_BARO, enable, ret);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_activate_humi
+ *
+ * Description:
+ *   Set Power Mode for Humidity Sensor. If enable is true, set Power Mode 
+ *   to normal. Else set to sleep mode.
+ *
+ ****************************************************************************/
+
+static int bme280_activate_humi(FAR struct sensor_lowerhalf_s *lower,
+                           FAR struct file *filep,
+                           bool enable)
+{
+  DEBUGASSERT(lower != NULL);
+  bme280_info("enable=%d\n", enable);
+  int ret;
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_humi);
+  bme280_info("priv=%p, sensor_humi=%p\n", priv, lower); ////
+
+  /* Set the power mode */
+
+  ret = bme280_enable(priv, enable);
+  bme280_trace(priv, BME280_TRACE_ACTIVATE, BME280_TRACE_HUMI, enable, ret);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_sample_save
+ *
+ * Description:
+ *   Save the compensated pressure, temperature and humidity as the latest
+ *   sample for the Barometer and Humidity Sensors
+ *
+ ****************************************************************************/
+
+static void bme280_sample_save(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t timestamp = bme280_now();
+
+  /* Save the latest sample for the Barometer and Humidity Sensors */
+
+  bme280_convert(priv->data, &priv->baro, &priv->humi);
+  priv->baro.timestamp   = timestamp;
+  priv->humi.timestamp   = timestamp;
+  priv->fixed.timestamp   = timestamp;
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+  priv->fixed.temperature = (int32_t)lroundf(priv->data->temperature * 100.0f);
+  priv->fixed.pressure    = (uint32_t)lroundf(priv->data->pressure * 256.0f);
+  priv->fixed.humidity    = (uint32_t)lroundf(priv->data->humidity * 1024.0f);
+#else
+  priv->fixed.temperature = priv->data->comp_temp;
+  priv->fixed.pressure    = priv->data->comp_press;
+  priv->fixed.humidity    = priv->data->comp_humidity;
+#endif
+  priv->cached           = true;
+
+  bme280_trace(priv, BME280_TRACE_SAMPLE, 0, 0, OK);
+  bme280_info("temperature=%" PRId32 " (0.01 °C), pressure=%" PRIu32
+              " (Pa/256), humidity=%" PRIu32 " (%%/1024)\n",
+              priv->fixed.temperature, priv->fixed.pressure,
+              priv->fixed.humidity);
+}
+
+/****************************************************************************
+ * Name: bme280_sample
+ *
+ * Description:
+ *   Read pressure, temperature and humidity from sensor, and save them as
+ *   the latest sample for the Barometer and Humidity Sensors
+ *
+ ****************************************************************************/
+
+static int bme280_sample(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  int ret;
+
+  /* Speed up the I2C Bus again after a fallback */
+
+  bme280_i2c_reprobe(priv);
+
+  /* Fetch the sensor data (from Zephyr BME280 Driver) */
+
+  ret = bme280_sample_fetch(priv, SENSOR_CHAN_ALL);
+  if (ret < 0)
+    {
+      priv->cached = false;
+      return ret;
+    }
+
+  bme280_sample_save(priv);
+  return OK;
+}
+
+#ifdef CONFIG_BME280_SCHEDULER
+/****************************************************************************
+ * Name: bme280_registry_add
+ *
+ * Description:
+ *   Add a device to the registry of the scheduler
+ *
+ ****************************************************************************/
+
+static int bme280_registry_add(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  int ret = -ENOSPC;
+  int i;
+
+  nxmutex_lock(&g_bme280_devices_lock);
+  for (i = 0; i < CONFIG_BME280_SCHEDULER_NDEVICES; i++)
+    {
+      if (g_bme280_devices[i] == NULL)
+        {
+          g_bme280_devices[i] = priv;
+          ret = OK;
+          break;
+        }
+    }
+
+  nxmutex_unlock(&g_bme280_devices_lock);
+  return ret;
+}
+
+#ifdef CONFIG_SENSORS_BME280_SIM
+/****************************************************************************
+ * Name: bme280_registry_remove
+ *
+ * Description:
+ *   Remove a device from the registry of the scheduler.  Only the
+ *   simulator benchmark removes devices, as drivers are never unloaded.
+ *
+ ****************************************************************************/
+
+static void bme280_registry_remove(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  int i;
+
+  nxmutex_lock(&g_bme280_devices_lock);
+  for (i = 0; i < CONFIG_BME280_SCHEDULER_NDEVICES; i++)
+    {
+      if (g_bme280_devices[i] == priv)
+        {
+          g_bme280_devices[i] = NULL;
+        }
+    }
+
+  nxmutex_unlock(&g_bme280_devices_lock);
+}
+#endif /* CONFIG_SENSORS_BME280_SIM */
+#endif /* CONFIG_BME280_SCHEDULER */
+
+/****************************************************************************
+ * Name: bme280_fetch
+ *
+ * Description:
+ *   Fetch pressure, temperature and humidity from sensor.  Returns the
+ *   newest sample of the worker (CONFIG_BME280_WORKER) unless the worker
+ *   fell two intervals behind, or the latest sample if it's still fresh,
+ *   without reading the sensor.
+ *
+ ****************************************************************************/
+
+static int bme280_fetch(FAR struct device *priv,
+                        FAR struct sensor_baro *baro_data,
+                        FAR struct sensor_humi *humi_data)
+{
+  DEBUGASSERT(priv != NULL);
+  DEBUGASSERT(baro_data != NULL || humi_data != NULL);
+  FAR const struct sensor_baro *baro = &priv->baro;
+  FAR const struct sensor_humi *humi = &priv->humi;
+  uint8_t sensors = (baro_data != NULL ? BME280_TRACE_BARO : 0) |
+                    (humi_data != NULL ? BME280_TRACE_HUMI : 0);
+  uint8_t source = BME280_TRACE_FROM_CACHE;
+  int ret;
+  uint64_t now;
+
+  /* Zephyr BME280 Driver assumes that sensor is not in sleep mode */
+
+  if (!priv->activated)
+    {
+      snerr("Device must be active before fetch\n");
+      return -EIO;
+    }
+
+  now = bme280_now();
+
+#ifdef CONFIG_BME280_WORKER
+  /* Return the newest sample of the worker, unless the worker is stalled */
+
+  if (priv->ring_count > 0 &&
+      now - priv->ring_baro[priv->ring_head].timestamp <
+      BME280_RING_MAX_AGE(priv))
+    {
+      priv->cache_hits++;
+      source = BME280_TRACE_FROM_RING;
+      baro = &priv->ring_baro[priv->ring_head];
+      humi = &priv->ring_humi[priv->ring_head];
+      goto out;
+    }
+#endif
+
+  /* Return the latest sample if it's still fresh */
+
+  if (priv->cached && now - priv->fixed.timestamp < priv->cache_us)
+    {
+      priv->cache_hits++;
+      goto out;
+    }
+
+  priv->cache_misses++;
+  source = BME280_TRACE_FROM_SENSOR;
+
+  ret = bme280_sample(priv);
+  if (ret < 0)
+    {
+      bme280_trace(priv, BME280_TRACE_FETCH, sensors, source, ret);
+      return ret;
+    }
+
+out:
+
+  /* Return the pressure and temperature data */
+
+  if (baro_data != NULL)
+    {
+      memcpy(baro_data, baro, sizeof(*baro_data));
+    }
+
+  /* Return the humidity data */
+
+  if (humi_data != NULL)
+    {
+      memcpy(humi_data, humi, sizeof(*humi_data));
+    }
+
+  bme280_trace(priv, BME280_TRACE_FETCH, sensors, source, OK);
+  bme280_info("cache_hits=%" PRIu32 ", cache_misses=%" PRIu32 "\n",
+              priv->cache_hits, priv->cache_misses);
+  return 0;
+}
+
+#ifdef CONFIG_BME280_PUSH_MODE
+/****************************************************************************
+ * Name: bme280_push
+ *
+ * Description:
+ *   Push the pending samples of the ring buffer, oldest first, to the
+ *   subscribers of the Barometer and Humidity Sensors, straight from the
+ *   ring.  Each sensor gets one push event for the whole batch, or two
+ *   when the batch wraps around the end of the ring.
+ *
+ ****************************************************************************/
+
+static void bme280_push(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  uint8_t count = priv->ring_pending;
+  uint8_t index;
+  uint8_t first;
+
+  /* Oldest pending sample, and the samples up to the end of the ring */
+
+  index = (priv->ring_head + CONFIG_BME280_RING_SIZE + 1 - count) %
+          CONFIG_BME280_RING_SIZE;
+  first = count < CONFIG_BME280_RING_SIZE - index ?
+          count : CONFIG_BME280_RING_SIZE - index;
+
+  priv->ring_pending = 0;
+  priv->push_events++;
+
+  priv->sensor_baro.push_event(priv->sensor_baro.priv,
+                               &priv->ring_baro[index],
+                               first * sizeof(struct sensor_baro));
+  priv->sensor_humi.push_event(priv->sensor_humi.priv,
+                               &priv->ring_humi[index],
+                               first * sizeof(struct sensor_humi));
+
+  /* The rest from the start of the ring */
+
+  if (first < count)
+    {
+      priv->sensor_baro.push_event(priv->sensor_baro.priv,
+                                   priv->ring_baro,
+                                   (count - first) *
+                                   sizeof(struct sensor_baro));
+      priv->sensor_humi.push_event(priv->sensor_humi.priv,
+                                   priv->ring_humi,
+                                   (count - first) *
+                                   sizeof(struct sensor_humi));
+    }
+}
+#endif /* CONFIG_BME280_PUSH_MODE */
+
+#ifdef CONFIG_BME280_DUAL
+/****************************************************************************
+ * Name: bme280_dual_restart
+ *
+ * Description:
+ *   Restart Dual Mode after the device was resumed or reconfigured.  The
+ *   second sensor gets the settings of the first, and the worker starts it
+ *   half a period after the first measurement of the first.  The merged
+ *   interval is set in interval_us.
+ *
+ ****************************************************************************/
+
+static int bme280_dual_restart(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  FAR struct device *peer = priv->peer;
+  FAR struct bme280_data *data = priv->data;
+  FAR const uint32_t *t_sb = g_bmp280_standby_us;
+  int ret;
+  int i;
+
+  if (peer == NULL)
+    {
+      return OK;
+    }
+
+  if (data->chip_id == BME280_CHIP_ID)
+    {
+      t_sb = g_bme280_standby_us;
+    }
+
+  priv->period_us   = bme280_meas_time_us(data->ctrl_meas, data->ctrl_hum) +
+                      t_sb[(data->config >> 5) & 0x07];
+  priv->interval_us = priv->period_us / 2;
+  priv->resyncs     = 0;
+  for (i = 0; i < 2; i++)
+    {
+      priv->start_us[i] = 0;
+      priv->done_us[i]  = 0;
+      priv->seen_us[i]  = 0;
+      priv->cycle_us[i]  = 0;
+      priv->meas_us[i]   = 0;
+      priv->window_us[i] = CONFIG_BME280_DUAL_WINDOW_US;
+    }
+
+  /* Stop the second sensor.  It gets the settings of the first on
+   * resume.
+   */
+
+  if (peer->activated)
+    {
+      peer->activated = false;
+      ret = bme280_pm_action(peer, PM_DEVICE_ACTION_SUSPEND);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  ret = bme280_chip_reconfigure(peer, data->ctrl_hum, data->ctrl_meas,
+                                data->config);
+  if (ret < 0 || !priv->activated)
+    {
+      return ret;
+    }
+
+  /* Restart the first sensor now, so we know its phase */
+
+  ret = bme280_pm_action(priv, PM_DEVICE_ACTION_SUSPEND);
+  if (ret >= 0)
+    {
+      ret = bme280_pm_action(priv, PM_DEVICE_ACTION_RESUME);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  priv->start_us[0] = bme280_now();
+  work_queue(LPWORK, &priv->work, bme280_worker, priv, 0);
+
+#ifdef CONFIG_BME280_PUSH_MODE
+  bme280_set_batch(priv, &priv->latency_us);
+#endif
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_predict
+ *
+ * Description:
+ *   Return the predicted completion of the next measurement of sensor i,
+ *   and in begin and end the window for reading it.  The window is wide
+ *   until the measurement time and the period of the sensor are known,
+ *   and after a measurement completed before the window.
+ *
+ ****************************************************************************/
+
+static uint64_t bme280_dual_predict(FAR struct device *priv, int i,
+                                    FAR uint64_t *begin,
+                                    FAR uint64_t *end)
+{
+  DEBUGASSERT(priv != NULL && begin != NULL && end != NULL);
+  uint32_t t_meas;
+  uint32_t window = priv->window_us[i];
+  uint64_t pred;
+
+  t_meas = bme280_meas_time_us(priv->data->ctrl_meas, priv->data->ctrl_hum);
+  if (priv->done_us[i] == 0)
+    {
+      /* First measurement since start.  The datasheet gives the maximum
+       * measurement time, the typical one is about 15% shorter.
+       */
+
+      pred = priv->start_us[i] + (priv->meas_us[i] != 0 ?
+                                  priv->meas_us[i] : t_meas);
+      *begin = priv->meas_us[i] != 0 ? pred - window :
+               priv->start_us[i] + t_meas * 3 / 4;
+    }
+  else if (priv->cycle_us[i] == 0)
+    {
+      /* Second measurement since start.  The nominal period is off by
+       * the measurement time and the oscillator error.
+       */
+
+      window = window > priv->period_us / 16 ? window :
+                                               priv->period_us / 16;
+      pred   = priv->done_us[i] + priv->period_us;
+      *begin = pred - window;
+    }
+  else
+    {
+      pred   = priv->done_us[i] + priv->cycle_us[i];
+      *begin = pred - window;
+    }
+
+  *end = pred + window;
+  return pred;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_track
+ *
+ * Description:
+ *   Estimate the completion of a new measurement of sensor i, seen by the
+ *   read that ended at after_us.  It completed between the last read
+ *   without it and this read: in the middle if they were close, else at
+ *   the prediction moved into that bracket.  The estimates correct the
+ *   phase and the period of the sensor like an alpha-beta filter: 1/4 of
+ *   the error goes into the phase and 1/8 into the period.  If the reads
+ *   missed the completion, the next window is wider.
+ *
+ ****************************************************************************/
+
+static void bme280_dual_track(FAR struct device *priv, int i,
+                              uint64_t after_us)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t begin;
+  uint64_t end;
+  uint64_t pred = bme280_dual_predict(priv, i, &begin, &end);
+  uint64_t done;
+  int64_t err;
+  bool bracketed = priv->seen_us[i] != 0 &&
+                   after_us - priv->seen_us[i] <=
+                   2 * CONFIG_BME280_DUAL_WINDOW_US;
+
+  if (bracketed)
+    {
+      done = priv->seen_us[i] + (after_us - priv->seen_us[i]) / 2;
+    }
+  else
+    {
+      done = pred < after_us ? pred : after_us;
+      done = done > priv->seen_us[i] ? done : priv->seen_us[i];
+    }
+
+  if (bracketed)
+    {
+      priv->window_us[i] = priv->window_us[i] / 2 >
+                           CONFIG_BME280_DUAL_WINDOW_US ?
+                           priv->window_us[i] / 2 :
+                           CONFIG_BME280_DUAL_WINDOW_US;
+    }
+  else
+    {
+      priv->window_us[i] = 2 * priv->window_us[i] < priv->period_us / 8 ?
+                           2 * priv->window_us[i] : priv->period_us / 8;
+    }
+
+  priv->seen_us[i] = 0;
+  err = (int64_t)(done - pred);
+
+  if (priv->done_us[i] == 0)
+    {
+      /* First measurement since start gives the measurement time */
+
+      err = (int64_t)(done - priv->start_us[i]) - priv->meas_us[i];
+      if (bracketed)
+        {
+          priv->meas_us[i] += priv->meas_us[i] == 0 ? err : err / 4;
+        }
+
+      priv->done_us[i] = done;
+    }
+  else if (priv->cycle_us[i] == 0)
+    {
+      /* Second measurement gives the period */
+
+      if (bracketed)
+        {
+          priv->cycle_us[i] = done - priv->done_us[i];
+        }
+
+      priv->done_us[i] = done;
+    }
+  else if (err > (int64_t)(priv->cycle_us[i] / 4) ||
+           err < -(int64_t)(priv->cycle_us[i] / 4))
+    {
+      /* Lost track, the worker was late by a period or more */
+
+      priv->done_us[i] = done;
+    }
+  else
+    {
+      priv->done_us[i]  = pred + err / 4;
+      priv->cycle_us[i] += err / 8;
+    }
+}
+
+/****************************************************************************
+ * Name: bme280_dual_poll
+ *
+ * Description:
+ *   Read sensor i until it has a new measurement or until end_us, and save
+ *   the new measurement with its estimated completion as timestamp.  The
+ *   measurement is new when the sensor is not measuring and the data
+ *   registers changed.  Returns -EAGAIN if there's none.
+ *
+ ****************************************************************************/
+
+static int bme280_dual_poll(FAR struct device *priv, int i,
+                            uint64_t end_us)
+{
+  DEBUGASSERT(priv != NULL);
+  FAR struct device *dev = i == 0 ? priv : priv->peer;
+  const int raw = BME280_REG_PRESS_MSB - BME280_REG_STATUS;
+  uint8_t buf[BME280_BURST_SIZE];
+  uint64_t before;
+  uint64_t after;
+  int ret;
+
+  memset(buf, 0, sizeof(buf));
+  for (; ; )
+    {
+      before = bme280_now();
+      ret = bme280_burst_read(dev, buf);
+      after = bme280_now();
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      if (!(buf[0] & (BME280_STATUS_MEASURING | BME280_STATUS_IM_UPDATE)) &&
+          memcmp(&buf[raw], &priv->burst[i][raw], BME280_RAW_SIZE) != 0)
+        {
+          break;
+        }
+
+      priv->seen_us[i] = before;
+      if (after >= end_us)
+        {
+          return -EAGAIN;
+        }
+
+      usleep(BME280_POLL_US);
+    }
+
+  memcpy(priv->burst[i], buf, sizeof(buf));
+  bme280_dual_track(priv, i, after);
+
+  bme280_burst_compensate(dev, buf);
+  bme280_sample_save(dev);
+  dev->baro.timestamp  = priv->done_us[i];
+  dev->humi.timestamp  = priv->done_us[i];
+  dev->fixed.timestamp = priv->done_us[i];
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_resync
+ *
+ * Description:
+ *   Check the phase of the second sensor after a new measurement of it.
+ *   The oscillators of the two sensors differ, so the second sensor
+ *   drifts away from half a period after the first.  If it would drift
+ *   more than 1 / 2^CONFIG_BME280_DUAL_RESYNC_SHIFT of a period by its
+ *   next measurement, put it to sleep so that the worker starts it again
+ *   in phase.
+ *
+ ****************************************************************************/
+
+static int bme280_dual_resync(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL && priv->peer != NULL);
+  int64_t cycle = priv->cycle_us[0];
+  int64_t phase;
+
+  if (cycle == 0 || priv->done_us[0] == 0)
+    {
+      return OK;
+    }
+
+  /* Phase at the next measurement, from the difference of the periods */
+
+  phase = (int64_t)(priv->done_us[1] - priv->done_us[0]) % cycle;
+  phase = (phase < 0 ? phase + cycle : phase) - cycle / 2;
+  if (priv->cycle_us[1] != 0)
+    {
+      phase += (int64_t)priv->cycle_us[1] - cycle;
+    }
+
+  if (phase <= (cycle >> CONFIG_BME280_DUAL_RESYNC_SHIFT) &&
+      phase >= -(cycle >> CONFIG_BME280_DUAL_RESYNC_SHIFT))
+    {
+      return OK;
+    }
+
+  priv->peer->activated = false;
+  priv->start_us[1] = 0;
+  priv->resyncs++;
+  return bme280_pm_action(priv->peer, PM_DEVICE_ACTION_SUSPEND);
+}
+
+/****************************************************************************
+ * Name: bme280_dual_start
+ *
+ * Description:
+ *   Return when to start the second sensor, so that it completes its
+ *   first measurement half a period after a measurement of the first
+ *   sensor, and after the last measurement of either.  The second sensor
+ *   drifts by the difference of the periods, so it starts half of that
+ *   ahead.  Returns UINT64_MAX until the phase of the first sensor is
+ *   known.
+ *
+ ****************************************************************************/
+
+static uint64_t bme280_dual_start(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  uint64_t cycle = priv->cycle_us[0];
+  uint64_t meas = priv->meas_us[1];
+  uint64_t last = priv->done_us[0];
+  uint64_t target;
+
+  if (priv->done_us[0] == 0)
+    {
+      return UINT64_MAX;
+    }
+
+  if (cycle == 0)
+    {
+      cycle = priv->period_us;
+    }
+
+  if (meas == 0)
+    {
+      meas = bme280_meas_time_us(priv->data->ctrl_meas,
+                                 priv->data->ctrl_hum);
+    }
+
+  if (priv->done_us[1] > last)
+    {
+      last = priv->done_us[1];
+    }
+
+  target = priv->done_us[0] + cycle / 2;
+  if (priv->cycle_us[1] != 0)
+    {
+      target -= ((int64_t)priv->cycle_us[1] - (int64_t)cycle) / 2;
+    }
+
+  while (target < last + meas)
+    {
+      target += cycle;
+    }
+
+  return target - meas;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_calibrate
+ *
+ * Description:
+ *   Update the offset of the second sensor with a new sample of the
+ *   first.  The sample of the second sensor taken between the last two
+ *   samples of the first is compared with their mean, if it was taken
+ *   near the middle.
+ *
+ ****************************************************************************/
+
+static void bme280_dual_calibrate(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  FAR struct bme280_offset_s *offset = &priv->offset;
+  FAR const struct bme280_sample_s *a = &priv->last[0];
+  FAR const struct bme280_sample_s *b = &priv->last[1];
+  const float alpha = 1.0f / (1 << CONFIG_BME280_DUAL_CAL_SHIFT);
+  uint64_t span = priv->baro.timestamp - a->baro.timestamp;
+  int64_t middle;
+  float temperature;
+  float pressure;
+  float humidity;
+
+  /* Twice the distance of the second sensor from the middle */
+
+  middle = (int64_t)(2 * b->baro.timestamp - a->baro.timestamp -
+                     priv->baro.timestamp);
+  if (a->baro.timestamp != 0 && b->baro.timestamp > a->baro.timestamp &&
+      b->baro.timestamp < priv->baro.timestamp &&
+      middle <= (int64_t)(span / 8) && middle >= -(int64_t)(span / 8))
+    {
+      temperature = b->baro.temperature -
+                    (a->baro.temperature + priv->baro.temperature) / 2;
+      pressure    = b->baro.pressure -
+                    (a->baro.pressure + priv->baro.pressure) / 2;
+      humidity    = b->humi.humidity -
+                    (a->humi.humidity + priv->humi.humidity) / 2;
+
+      if (priv->noffset++ == 0)
+        {
+          offset->temperature = temperature;
+          offset->pressure    = pressure;
+          offset->humidity    = humidity;
+        }
+      else
+        {
+          offset->temperature += (temperature - offset->temperature) * alpha;
+          offset->pressure    += (pressure - offset->pressure) * alpha;
+          offset->humidity    += (humidity - offset->humidity) * alpha;
+        }
+    }
+
+  priv->last[0].baro = priv->baro;
+  priv->last[0].humi = priv->humi;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_correct
+ *
+ * Description:
+ *   Save a new sample of the second sensor, without its offset, as the
+ *   latest sample of the device
+ *
+ ****************************************************************************/
+
+static void bme280_dual_correct(FAR struct device *priv)
+{
+  DEBUGASSERT(priv != NULL);
+  FAR const struct device *peer = priv->peer;
+  FAR const struct bme280_offset_s *offset = &priv->offset;
+
+  priv->last[1].baro = peer->baro;
+  priv->last[1].humi = peer->humi;
+
+  priv->baro = peer->baro;
+  priv->humi = peer->humi;
+  priv->baro.temperature -= offset->temperature;
+  priv->baro.pressure    -= offset->pressure;
+  priv->humi.humidity    -= offset->humidity;
+
+  priv->fixed = peer->fixed;
+  priv->fixed.temperature -= (int32_t)lroundf(offset->temperature * 100.0f);
+  priv->fixed.pressure    -= (int32_t)lroundf(offset->pressure * 25600.0f);
+  priv->fixed.humidity    -= (int32_t)lroundf(offset->humidity * 1024.0f);
+  priv->cached = true;
+}
+
+/****************************************************************************
+ * Name: bme280_dual_sample
+ *
+ * Description:
+ *   Read the next measurement of the two sensors, or start the second
+ *   sensor, whichever is due first.  Returns -EAGAIN if there's no new
+ *   measurement, and in delay_us the time until the worker should run
+ *   again.  The worker wakes up on the tick before a measurement is due,
+ *   and waits for the rest here.
+ *
+ ****************************************************************************/
+
+static int bme280_dual_sample(FAR struct device *priv,
+                              FAR uint32_t *delay_us)
+{
+  DEBUGASSERT(priv != NULL && priv->peer != NULL);
+  DEBUGASSERT(delay_us != NULL);
+  uint64_t now = bme280_now();
+  uint64_t begin[3];
+  uint64_t end[2];
+  int ret;
+  int i;
+  int j;
+
+  /* Reading the sensors (0 and 1) and starting the second sensor (2) */
+
+  for (i = 0; i < 2; i++)
+    {
+      begin[i] = UINT64_MAX;
+      if (priv->start_us[i] != 0)
+        {
+          bme280_dual_predict(priv, i, &begin[i], &end[i]);
+        }
+    }
+
+  begin[2] = priv->start_us[1] == 0 ? bme280_dual_start(priv) :
+                                      UINT64_MAX;
+
+  j = 0;
+  for (i = 1; i < 3; i++)
+    {
+      if (begin[i] < begin[j])
+        {
+          j = i;
+        }
+    }
+
+  if (begin[j] == UINT64_MAX)
+    {
+      *delay_us = priv->interval_us;
+      return -EAGAIN;
+    }
+
+  if (begin[j] > now + USEC_PER_TICK)
+    {
+      *delay_us = begin[j] - now - USEC_PER_TICK;
+      return -EAGAIN;
+    }
+
+  if (begin[j] > now)
+    {
+      usleep(begin[j] - now);
+    }
+
+  if (j == 2)
+    {
+      ret = bme280_pm_action(priv->peer, PM_DEVICE_ACTION_RESUME);
+      if (ret >= 0)
+        {
+          priv->peer->activated = true;
+          priv->start_us[1] = bme280_now();
+          priv->done_us[1]  = 0;
+          priv->seen_us[1]  = 0;
+        }
+
+      *delay_us = ret < 0 ? USEC_PER_TICK : 0;
+      return ret < 0 ? ret : -EAGAIN;
+    }
+
+  /* Come back at once for the next event, or on the next tick if the
+   * sensor wasn't ready
+   */
+
+  ret = bme280_dual_poll(priv, j, end[j]);
+  *delay_us = ret < 0 ? USEC_PER_TICK : 0;
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (j == 0)
+    {
+      bme280_dual_calibrate(priv);
+      return OK;
+    }
+
+  bme280_dual_correct(priv);
+  return bme280_dual_resync(priv);
+}
+#endif /* CONFIG_BME280_DUAL */
+
+#ifdef CONFIG_BME280_WORKER
+/****************************************************************************
+ * Name: bme280_worker
+ *
+ * Description:
+ *   Sample the sensor on the LP work queue and append the sample to the
+ *   ring buffer.  Runs once per interval while the sensor is active.
+ *
+ ****************************************************************************/
+
+static void bme280_worker(FAR void *arg)
+{
+  FAR struct device *priv = (FAR struct device *)arg;
+  clock_t start = clock_systime_ticks();
+  clock_t period;
+  clock_t elapsed;
+#ifdef CONFIG_BME280_DUAL
+  uint32_t delay = 0;
+#endif
+  uint8_t head;
+  int ret;
+
+  DEBUGASSERT(priv != NULL);
+  bme280_lock(priv);
+
+  /* Stop if the sensor was suspended meanwhile */
+
+  if (!priv->activated)
+    {
+      bme280_unlock(priv);
+      return;
+    }
+
+#ifdef CONFIG_BME280_DUAL
+  ret = priv->peer != NULL ? bme280_dual_sample(priv, &delay) :
+                             bme280_sample(priv);
+#else
+  ret = bme280_sample(priv);
+#endif
+  if (ret >= 0)
+    {
+      head = (priv->ring_head + 1) % CONFIG_BME280_RING_SIZE;
+      priv->ring_baro[head] = priv->baro;
+      priv->ring_humi[head] = priv->humi;
+      priv->ring_head = head;
+      if (priv->ring_count < CONFIG_BME280_RING_SIZE)
+        {
+          priv->ring_count++;
+        }
+
+#ifdef CONFIG_BME280_PUSH_MODE
+      /* Push the batch once it's complete */
+
+      priv->ring_pending++;
+      if (priv->ring_pending >= priv->batch_size)
+        {
+          bme280_push(priv);
+        }
+#endif
+    }
+  else if (ret != -EAGAIN)
+    {
+      snerr("Failed to sample: %d\n", ret);
+    }
+
+  /* Sample again one interval after the start of this sample */
+
+  period  = USEC2TICK(priv->interval_us);
+  elapsed = clock_systime_ticks() - start;
+
+#ifdef CONFIG_BME280_DUAL
+  /* Or at the next measurement of the two sensors, on the tick after */
+
+  if (priv->peer != NULL)
+    {
+      period  = (delay + USEC_PER_TICK - 1) / USEC_PER_TICK;
+      elapsed = 0;
+    }
+#endif
+  work_queue(LPWORK, &priv->work, bme280_worker, priv,
+             elapsed < period ? period - elapsed : 0);
+
+  bme280_unlock(priv);
+}
+#endif /* CONFIG_BME280_WORKER */
+
+/****************************************************************************
+ * Name: bme280_enable
+ *
+ * Description:
+ *   Set Power Mode for the Barometer and Humidity Sensors, and start or
+ *   stop the worker (CONFIG_BME280_WORKER)
+ *
+ ****************************************************************************/
+
+static int bme280_enable(FAR struct device *priv, bool enable)
+{
+  DEBUGASSERT(priv != NULL);
+  int ret;
+
+  bme280_lock(priv);
+  ret = bme280_activate(priv, enable);
+
+#ifdef CONFIG_BME280_WORKER
+  if (ret >= 0 && enable)
+    {
+      /* Drop the samples taken before sleep and sample now */
+
+      priv->ring_count = 0;
+#ifdef CONFIG_BME280_PUSH_MODE
+      priv->ring_pending = 0;
+#endif
+#ifdef CONFIG_BME280_DUAL
+      ret = bme280_dual_restart(priv);
+#endif
+      work_queue(LPWORK, &priv->work, bme280_worker, priv, 0);
+    }
+  else if (ret >= 0)
+    {
+      work_cancel(LPWORK, &priv->work);
+
+#ifdef CONFIG_BME280_DUAL
+      /* Put the second sensor to sleep too */
+
+      if (priv->peer != NULL && priv->peer->activated)
+        {
+          priv->peer->activated = false;
+          ret = bme280_pm_action(priv->peer, PM_DEVICE_ACTION_SUSPEND);
+        }
+#endif
+
+#ifdef CONFIG_BME280_PUSH_MODE
+      /* Don't hold back the samples of an incomplete batch */
+
+      if (priv->ring_pending > 0)
+        {
+          bme280_push(priv);
+        }
+#endif
+    }
+#endif
+
+  bme280_unlock(priv);
+  return ret;
+}
+
+#ifdef CONFIG_BME280_PUSH_MODE
+/****************************************************************************
+ * Name: bme280_batch_baro
+ *
+ * Description:
+ *   Called by NuttX to set Batch Latency for Barometer Sensor
+ *
+ ****************************************************************************/
+
+static int bme280_batch_baro(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR unsigned long *latency_us)
+{
+  DEBUGASSERT(lower != NULL);
+  DEBUGASSERT(latency_us != NULL);
+  sninfo("latency_us=%lu\n", *latency_us);
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_baro);
+
+  /* Set the batch latency */
+
+  bme280_lock(priv);
+  bme280_set_batch(priv, latency_us);
+  bme280_unlock(priv);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_batch_humi
+ *
+ * Description:
+ *   Called by NuttX to set Batch Latency for Humidity Sensor
+ *
+ ****************************************************************************/
+
+static int bme280_batch_humi(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR unsigned long *latency_us)
+{
+  DEBUGASSERT(lower != NULL);
+  DEBUGASSERT(latency_us != NULL);
+  sninfo("latency_us=%lu\n", *latency_us);
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_humi);
+
+  /* Set the batch latency */
+
+  bme280_lock(priv);
+  bme280_set_batch(priv, latency_us);
+  bme280_unlock(priv);
+  return OK;
+}
+#else
+/****************************************************************************
+ * Name: bme280_fetch_baro
+ *
+ * Description:
+ *   Called by NuttX to fetch pressure and temperature from sensor
+ *
+ ****************************************************************************/
+
+static int bme280_fetch_baro(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR char *buffer, size_t buflen)
+{
+  DEBUGASSERT(lower != NULL);
+  DEBUGASSERT(buffer != NULL);
+  bme280_info("buflen=%d\n", buflen);
+  int ret;
+  struct sensor_baro baro_data;
+
+  /* Get device struct */
+
+  FAR struct device *priv = container_of(lower,
+                                               FAR struct device,
+                                               sensor_baro);
+  bme280_info("priv=%p, sensor_baro=%p\n", priv, lower); ////
+
+  /* Validate buffer size */
+
+  if (buflen != sizeof(baro_data))
+    {
+      return -EINVAL;
+    }
+
+  /* Fetch the sensor data */
+
+  bme280_lock(priv);
+  ret = bme280_fetch(priv, &baro_data, NULL);
+  bme280_unlock(priv);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  /* Return the sensor data */
+
+  memcpy(buffer, &baro_data, sizeof(baro_data));
+  return buflen;
+}
+
+/****************************************************************************
+ * Name: bme280_fetch_humi
+ *
+ * Description:
+ *   Called by NuttX to fetch humidity from sensor
+ *
+ ****************************************************************************/
+
+static int bme280_fetch_humi(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep,
+                        FAR char *buffer, size_t buflen)
+{
+  DEBUGASSERT(lower != NULL);
+  DEBUGASSERT(buffer != NULL);
+  bme280_info("buflen=%d\n", buflen);
+  int ret;
+  struct sensor_humi humi_data;
 
   /* Get device struct */
 
   FAR struct device *priv = container_of(lower,
                                                FAR struct device,
                                                sensor_humi);
-  sninfo("priv=%p, sensor_humi=%p\n", priv, lower); ////
+  bme280_info("priv=%p, sensor_humi=%p\n", priv, lower); ////
 
-  /* Set the standby interval */
+  /* Validate buffer size */
+
+  if (buflen != sizeof(humi_data))
+    {
+      return -EINVAL;
+    }
+
+  /* Fetch the sensor data */
+
+  bme280_lock(priv);
+  ret = bme280_fetch(priv, NULL, &humi_data);
+  bme280_unlock(priv);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  /* Return the sensor data */
 
-  return bme280_set_interval(priv, period_us);
+  memcpy(buffer, &humi_data, sizeof(humi_data));
+  return buflen;
 }
+#endif /* CONFIG_BME280_PUSH_MODE */
 
 /****************************************************************************
- * Name: bme280_activate
+ * Name: bme280_set_ctrl
  *
  * Description:
- *   Set Power Mode for the device. If enable is true, set Power Mode 
- *   to normal. Else set to sleep mode.
+ *   Set oversampling, IIR filter and power mode.  Only the registers that
+ *   change are written to the sensor.
  *
  ****************************************************************************/
 
-static int bme280_activate(FAR struct device *priv,
-                           bool enable)
+static int bme280_set_ctrl(FAR struct device *priv,
+                           FAR const struct bme280_ctrl_s *ctrl)
 {
   DEBUGASSERT(priv != NULL);
-  int ret = 0;
+  FAR struct bme280_data *data = priv->data;
+  unsigned long period_us = priv->request_us;
+  uint8_t ctrl_hum;
+  uint8_t ctrl_meas;
+  uint8_t config;
+  uint8_t regval;
+  int ret;
 
-  if (enable)
+  if (ctrl == NULL ||
+      ctrl->osrs_t > BME280_OVERSAMP_16X ||
+      ctrl->osrs_p > BME280_OVERSAMP_16X ||
+      ctrl->osrs_h > BME280_OVERSAMP_16X ||
+      ctrl->filter > BME280_FILTER_COEFF_16 ||
+      (ctrl->mode != BME280_OPMODE_NORMAL &&
+       ctrl->mode != BME280_OPMODE_FORCED))
     {
-      /* Set power mode to normal */
+      return -EINVAL;
+    }
 
-      ret = bme280_pm_action(priv, PM_DEVICE_ACTION_RESUME);
+#ifdef CONFIG_BME280_DUAL
+  /* Dual Mode interleaves the measurements of Normal Mode */
+
+  if (priv->peer != NULL && ctrl->mode != BME280_OPMODE_NORMAL)
+    {
+      return -EINVAL;
     }
-  else
+#endif
+
+  sninfo("osrs_t=%d, osrs_p=%d, osrs_h=%d, filter=%d, mode=%d\n",
+         ctrl->osrs_t, ctrl->osrs_p, ctrl->osrs_h, ctrl->filter,
+         ctrl->mode);
+
+  /* Keep the standby duration and SPI 3-wire bits of CONFIG, unless the
+   * standby duration follows the requested interval
+   */
+
+  ctrl_hum  = ctrl->osrs_h;
+  ctrl_meas = (ctrl->osrs_t << 5) | (ctrl->osrs_p << 2) | ctrl->mode;
+  config    = (data->config & ~BME280_FILTER_MASK) | (ctrl->filter << 2);
+
+  /* The measurement time changes with oversampling, so choose the
+   * standby duration again for the requested interval
+   */
+
+  if (period_us != 0)
     {
-      /* Set to sleep mode */
+#ifdef CONFIG_BME280_DUAL
+      if (priv->peer != NULL)
+        {
+          period_us *= 2;
+        }
+#endif
 
-      ret = bme280_pm_action(priv, PM_DEVICE_ACTION_SUSPEND);
+      regval = bme280_select_standby(priv, ctrl_meas, ctrl_hum,
+                                     &period_us);
+      config = (config & ~BME280_STANDBY_MASK) | (regval << 5);
     }
 
-  if (ret >= 0)
+  ret = bme280_chip_reconfigure(priv, ctrl_hum, ctrl_meas, config);
+  if (ret < 0)
     {
-      priv->activated = enable;
+      return ret;
+    }
+
+  priv->cached = false;
+
+#ifdef CONFIG_BME280_WORKER
+  if (period_us != 0)
+    {
+      priv->interval_us = period_us;
+#  ifdef CONFIG_BME280_PUSH_MODE
+      bme280_set_batch(priv, &priv->latency_us);
+#  endif
     }
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+  /* The measurement time changed, restart the sensors half a period
+   * apart
+   */
+
+  ret = bme280_dual_restart(priv);
+#endif
 
   return ret;
 }
 
 /****************************************************************************
- * Name: bme280_activate_baro
+ * Name: bme280_get_ctrl
  *
  * Description:
- *   Set Power Mode for Barometer Sensor. If enable is true, set Power Mode 
- *   to normal. Else set to sleep mode.
+ *   Get oversampling, IIR filter and power mode
  *
  ****************************************************************************/
 
-static int bme280_activate_baro(FAR struct sensor_lowerhalf_s *lower,
-                           FAR struct file *filep,
-                           bool enable)
+static int bme280_get_ctrl(FAR struct device *priv,
+                           FAR struct bme280_ctrl_s *ctrl)
+{
+  DEBUGASSERT(priv != NULL);
+  FAR struct bme280_data *data = priv->data;
+
+  if (ctrl == NULL)
+    {
+      return -EINVAL;
+    }
+
+  ctrl->osrs_t = (data->ctrl_meas >> 5) & 0x07;
+  ctrl->osrs_p = (data->ctrl_meas >> 2) & 0x07;
+  ctrl->osrs_h = data->ctrl_hum & BME280_OSRS_H_MASK;
+  ctrl->filter = (data->config & BME280_FILTER_MASK) >> 2;
+  ctrl->mode   = data->ctrl_meas & BME280_MODE_MASK;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_fetch_fixed
+ *
+ * Description:
+ *   Fetch pressure, temperature and humidity in fixed-point, without
+ *   any floating-point conversion
+ *
+ ****************************************************************************/
+
+static int bme280_fetch_fixed(FAR struct device *priv,
+                              FAR struct bme280_fixed_s *fixed)
+{
+  DEBUGASSERT(priv != NULL);
+  struct sensor_humi humi_data;
+  int ret;
+
+  if (fixed == NULL)
+    {
+      return -EINVAL;
+    }
+
+  /* Fetch or reuse the latest sample */
+
+  ret = bme280_fetch(priv, NULL, &humi_data);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  memcpy(fixed, &priv->fixed, sizeof(*fixed));
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_control
+ *
+ * Description:
+ *   Handle the BME280-specific IOCTL Commands
+ *
+ ****************************************************************************/
+
+static int bme280_control(FAR struct device *priv,
+                          int cmd, unsigned long arg)
+{
+  DEBUGASSERT(priv != NULL);
+  int ret;
+
+  switch (cmd)
+    {
+      case SNIOC_BME280_REINIT:
+
+        /* Full init now if active, else on the next resume */
+
+        priv->data->calibrated = false;
+        priv->cached = false;
+        ret = priv->activated ? bme280_chip_init(priv) : OK;
+        break;
+
+      case SNIOC_BME280_SETCTRL:
+        ret = bme280_set_ctrl(priv,
+                              (FAR const struct bme280_ctrl_s *)arg);
+        break;
+
+      case SNIOC_BME280_GETCTRL:
+        ret = bme280_get_ctrl(priv, (FAR struct bme280_ctrl_s *)arg);
+        break;
+
+      case SNIOC_BME280_FETCH_FIXED:
+        ret = bme280_fetch_fixed(priv, (FAR struct bme280_fixed_s *)arg);
+        break;
+
+#ifdef CONFIG_BME280_RECORD
+      case SNIOC_BME280_GET_RECORD:
+        ret = bme280_get_record(priv, (FAR struct bme280_recordbuf_s *)arg);
+        break;
+#endif
+
+#ifdef CONFIG_BME280_TRACE
+      case SNIOC_BME280_GET_TRACE:
+        ret = bme280_get_trace(priv, (FAR struct bme280_tracebuf_s *)arg);
+        break;
+#endif
+
+#ifdef CONFIG_BME280_STATS
+      case SNIOC_BME280_GET_STATS:
+        ret = bme280_get_stats(priv, (FAR struct bme280_stats_s *)arg);
+        break;
+
+      case SNIOC_BME280_RESET_STATS:
+        bme280_reset_stats(priv);
+        ret = OK;
+        break;
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+      case SNIOC_BME280_GET_OFFSET:
+        if (priv->peer == NULL || arg == 0)
+          {
+            ret = -EINVAL;
+            break;
+          }
+
+        memcpy((FAR struct bme280_offset_s *)arg, &priv->offset,
+               sizeof(priv->offset));
+        ret = OK;
+        break;
+#endif
+
+      default:
+        ret = -ENOTTY;
+        break;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_control_baro
+ *
+ * Description:
+ *   Called by NuttX to handle IOCTL Commands for Barometer Sensor
+ *
+ ****************************************************************************/
+
+static int bme280_control_baro(FAR struct sensor_lowerhalf_s *lower,
+                          FAR struct file *filep,
+                          int cmd, unsigned long arg)
 {
   DEBUGASSERT(lower != NULL);
-  sninfo("enable=%d\n", enable);
+  sninfo("cmd=0x%x\n", cmd);
 
   /* Get device struct */
 
   FAR struct device *priv = container_of(lower,
                                                FAR struct device,
                                                sensor_baro);
-  sninfo("priv=%p, sensor_baro=%p\n", priv, lower); ////
+  int ret;
 
-  /* Set the power mode */
+#ifdef CONFIG_BME280_SCHEDULER
+  /* Sampling the bus locks every sensor on it, including this one */
+
+  if (cmd == SNIOC_BME280_SAMPLE_BUS)
+    {
+      if (priv->bus_io != &bme280_bus_io_i2c)
+        {
+          return -ENOTSUP;
+        }
+
+      return bme280_sample_bus(priv->bus.i2c.bus,
+                               (FAR struct bme280_cycle_s *)arg);
+    }
+#endif
 
-  return bme280_activate(priv, enable);
+  /* Handle the command */
+
+  bme280_lock(priv);
+  ret = bme280_control(priv, cmd, arg);
+  bme280_unlock(priv);
+  return ret;
 }
 
 /****************************************************************************
- * Name: bme280_activate_humi
+ * Name: bme280_control_humi
  *
  * Description:
- *   Set Power Mode for Humidity Sensor. If enable is true, set Power Mode 
- *   to normal. Else set to sleep mode.
+ *   Called by NuttX to handle IOCTL Commands for Humidity Sensor
  *
  ****************************************************************************/
 
-static int bme280_activate_humi(FAR struct sensor_lowerhalf_s *lower,
-                           FAR struct file *filep,
-                           bool enable)
+static int bme280_control_humi(FAR struct sensor_lowerhalf_s *lower,
+                          FAR struct file *filep,
+                          int cmd, unsigned long arg)
 {
   DEBUGASSERT(lower != NULL);
-  sninfo("enable=%d\n", enable);
+  sninfo("cmd=0x%x\n", cmd);
 
   /* Get device struct */
 
   FAR struct device *priv = container_of(lower,
                                                FAR struct device,
                                                sensor_humi);
-  sninfo("priv=%p, sensor_humi=%p\n", priv, lower); ////
+  int ret;
+
+#ifdef CONFIG_BME280_SCHEDULER
+  /* Sampling the bus locks every sensor on it, including this one */
+
+  if (cmd == SNIOC_BME280_SAMPLE_BUS)
+    {
+      if (priv->bus_io != &bme280_bus_io_i2c)
+        {
+          return -ENOTSUP;
+        }
+
+      return bme280_sample_bus(priv->bus.i2c.bus,
+                               (FAR struct bme280_cycle_s *)arg);
+    }
+#endif
+
+  /* Handle the command */
+
+  bme280_lock(priv);
+  ret = bme280_control(priv, cmd, arg);
+  bme280_unlock(priv);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: bme280_register_device
+ *
+ * Description:
+ *   Register a BME280 character device on the given I2C or SPI Bus, with
+ *   the second sensor of Dual Mode (or NULL)
+ *
+ ****************************************************************************/
+
+static int bme280_register_device(int devno,
+                                  FAR const struct bme280_bus_io *bus_io,
+                                  FAR const union bme280_bus *bus,
+                                  FAR struct device *peer)
+{
+  DEBUGASSERT(bus_io != NULL && bus != NULL);
+  sninfo("devno=%d\n", devno);
+  FAR struct device *priv;
+  FAR struct bme280_data *data;
+  int ret;
+
+  /* Initialize the device structure */
+
+  priv = (FAR struct device *)kmm_zalloc(sizeof(struct device));
+  if (!priv)
+    {
+      snerr("Failed to allocate instance\n");
+      return -ENOMEM;
+    }
+  sninfo("priv=%p, sensor_baro=%p, sensor_humi=%p\n", priv, &(priv->sensor_baro), &(priv->sensor_humi)); ////
+
+  /* Allocate the Compensation Parameters */
+
+  data = (FAR struct bme280_data *)kmm_zalloc(sizeof(struct bme280_data));
+  if (!data)
+    {
+      snerr("Failed to allocate data\n");
+      kmm_free(priv);
+      return -ENOMEM;
+    }
+
+  *data = (struct bme280_data)BME280_DATA_INIT;
+
+#ifdef CONFIG_SPI
+  /* Keep 3-wire SPI enabled when writing CONFIG */
+
+  if (bus_io == &bme280_bus_io_spi && bus->spi.three_wire)
+    {
+      data->config |= BME280_SPI_3W_ENABLE;
+    }
+#endif
+
+  priv->bus    = *bus;
+  priv->bus_io = bus_io;
+  priv->name = "BME280";
+  priv->data = data;
+  priv->activated = true;
+  priv->cache_us = CONFIG_BME280_CACHE_USEC;
+#ifdef CONFIG_BME280_WORKER
+  priv->interval_us = CONFIG_BME280_WORKER_INTERVAL_USEC;
+  nxmutex_init(&priv->lock);
+#endif
+#ifdef CONFIG_BME280_PUSH_MODE
+  priv->batch_size = 1;
+#endif
+#ifdef CONFIG_BME280_DUAL
+  priv->peer = peer;
+#endif
 
-  /* Set the power mode */
+  /* Initialize the Barometer Sensor */
 
-  return bme280_activate(priv, enable);
-}
+  priv->sensor_baro.ops = &g_baro_ops;
+  priv->sensor_baro.type = SENSOR_TYPE_BAROMETER;
+#ifdef CONFIG_BME280_PUSH_MODE
+  priv->sensor_baro.nbuffer = CONFIG_BME280_RING_SIZE;
+#endif
 
-/****************************************************************************
- * Name: bme280_fetch
- *
- * Description:
- *   Fetch pressure, temperature and humidity from sensor
- *
- ****************************************************************************/
+  /* Initialize the Humidity Sensor */
 
-static int bme280_fetch(FAR struct device *priv,
-                        FAR struct sensor_baro *baro_data,
-                        FAR struct sensor_humi *humi_data)
-{
-  DEBUGASSERT(priv != NULL);
-  DEBUGASSERT(baro_data != NULL || humi_data != NULL);
-  int ret;
-  struct timespec ts;
-  struct sensor_value val;
+  priv->sensor_humi.ops = &g_humi_ops;
+  priv->sensor_humi.type = SENSOR_TYPE_RELATIVE_HUMIDITY;
+#ifdef CONFIG_BME280_PUSH_MODE
+  priv->sensor_humi.nbuffer = CONFIG_BME280_RING_SIZE;
+#endif
 
-  /* Zephyr BME280 Driver assumes that sensor is not in sleep mode */
+#ifdef CONFIG_BME280_I2C_PROBE
+  /* Find the fastest reliable I2C frequency */
 
-  if (!priv->activated)
+  if (bus_io == &bme280_bus_io_i2c)
     {
-      snerr("Device must be active before fetch\n");
-      return -EIO;
+      ret = bme280_i2c_probe(priv);
+      if (ret < 0)
+        {
+          snerr("Failed to probe: %d\n", ret);
+          goto errout;
+        }
     }
+#endif
 
-  /* Fetch the sensor data (from Zephyr BME280 Driver) */
+  /* Initialize the Sensor Hardware */
 
-  ret = bme280_sample_fetch(priv, SENSOR_CHAN_ALL);
+  ret = bme280_chip_init(priv);
   if (ret < 0)
     {
-      return ret;
+      snerr("Failed to init: %d\n", ret);
+      goto errout;
     }
 
-  /* Get the pressure (from Zephyr BME280 Driver) */
+  /* Set power mode to sleep */
 
-  ret = bme280_channel_get(priv, SENSOR_CHAN_PRESS, &val);
+  ret = bme280_pm_action(priv, PM_DEVICE_ACTION_SUSPEND);
   if (ret < 0)
     {
-      return ret;
+      snerr("Failed to sleep: %d\n", ret);
+      goto errout;
     }
-  float pressure = get_sensor_value(&val) * 10;
+  priv->activated = false;
 
-  /* Get the temperature (from Zephyr BME280 Driver) */
+  /* Register the Barometer Sensor */
 
-  ret = bme280_channel_get(priv, SENSOR_CHAN_AMBIENT_TEMP, &val);
+  ret = sensor_register(&priv->sensor_baro, devno);
   if (ret < 0)
     {
-      return ret;
+      snerr("Failed to register barometer sensor: %d\n", ret);
+      goto errout;
     }
-  float temperature = get_sensor_value(&val);
 
-  /* Get the humidity (from Zephyr BME280 Driver) */
+  /* Register the Humidity Sensor */
 
-  ret = bme280_channel_get(priv, SENSOR_CHAN_HUMIDITY, &val);
+  ret = sensor_register(&priv->sensor_humi, devno);
   if (ret < 0)
     {
-      return ret;
+      snerr("Failed to register humidity sensor: %d\n", ret);
+      sensor_unregister(&priv->sensor_baro, devno);
+      goto errout;
     }
-  float humidity = get_sensor_value(&val);
-
-  /* Get the timestamp */
-  
-  clock_systime_timespec(&ts);
-  uint64_t timestamp = 1000000ull * ts.tv_sec + ts.tv_nsec / 1000;
 
-  /* Return the pressure and temperature data */
+#ifdef CONFIG_BME280_SCHEDULER
+  /* Sample with the other sensors on the bus */
 
-  if (baro_data != NULL)
+  if (bme280_registry_add(priv) < 0)
     {
-      baro_data->pressure    = pressure;
-      baro_data->temperature = temperature;
-      baro_data->timestamp   = timestamp;
+      snwarn("Too many devices for scheduler\n");
     }
+#endif
 
-  /* Return the humidity data */
+#ifdef CONFIG_SENSORS_BME280_SIM
+  g_bme280_registered = priv;
+#endif
 
-  if (humi_data != NULL)
-    {
-      humi_data->humidity    = humidity;
-      humi_data->timestamp   = timestamp;
-    }
+  sninfo("BME280 driver loaded successfully!\n");
+  return ret;
 
-  sninfo("temperature=%f °C, pressure=%f mbar, humidity=%f %%\n", temperature, pressure, humidity);
-  return 0;
+errout:
+#ifdef CONFIG_BME280_WORKER
+  nxmutex_destroy(&priv->lock);
+#endif
+  kmm_free(data);
+  kmm_free(priv);
+  return ret;
 }
 
+#ifdef CONFIG_SENSORS_BME280_SIM
 /****************************************************************************
- * Name: bme280_fetch_baro
+ * Name: bme280_unregister_device
  *
  * Description:
- *   Called by NuttX to fetch pressure and temperature from sensor
+ *   Undo bme280_register_device, and free the peer of Dual Mode.  Only the
+ *   simulator benchmark unregisters devices, as drivers are never
+ *   unloaded.
  *
  ****************************************************************************/
 
-static int bme280_fetch_baro(FAR struct sensor_lowerhalf_s *lower,
-                        FAR struct file *filep,
-                        FAR char *buffer, size_t buflen)
+static void bme280_unregister_device(FAR struct device *priv, int devno)
 {
-  DEBUGASSERT(lower != NULL);
-  DEBUGASSERT(buffer != NULL);
-  sninfo("buflen=%d\n", buflen);
-  int ret;
-  struct sensor_baro baro_data;
-
-  /* Get device struct */
+  DEBUGASSERT(priv != NULL);
 
-  FAR struct device *priv = container_of(lower,
-                                               FAR struct device,
-                                               sensor_baro);
-  sninfo("priv=%p, sensor_baro=%p\n", priv, lower); ////
+  sensor_unregister(&priv->sensor_humi, devno);
+  sensor_unregister(&priv->sensor_baro, devno);
 
-  /* Validate buffer size */
+#ifdef CONFIG_BME280_SCHEDULER
+  bme280_registry_remove(priv);
+#endif
+#ifdef CONFIG_BME280_WORKER
+  work_cancel(LPWORK, &priv->work);
+  nxmutex_destroy(&priv->lock);
+#endif
 
-  if (buflen != sizeof(baro_data))
+#ifdef CONFIG_BME280_DUAL
+  if (priv->peer != NULL)
     {
-      return -EINVAL;
+      kmm_free(priv->peer->data);
+      kmm_free(priv->peer);
     }
+#endif
 
-  /* Fetch the sensor data */
-
-  ret = bme280_fetch(priv, &baro_data, NULL);
-  if (ret < 0)
+  if (g_bme280_registered == priv)
     {
-      return ret;
+      g_bme280_registered = NULL;
     }
 
-  /* Return the sensor data */
-
-  memcpy(buffer, &baro_data, sizeof(baro_data));
-  return buflen;
+  kmm_free(priv->data);
+  kmm_free(priv);
 }
+#endif /* CONFIG_SENSORS_BME280_SIM */
 
 /****************************************************************************
- * Name: bme280_fetch_humi
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: bme280_register
  *
  * Description:
- *   Called by NuttX to fetch humidity from sensor
+ *   Register the BME280 character device at the default I2C address and
+ *   frequency
+ *
+ * Input Parameters:
+ *   devno   - Instance number for driver
+ *   i2c     - An instance of the I2C interface to use to communicate with
+ *             BME280
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
  *
  ****************************************************************************/
 
-static int bme280_fetch_humi(FAR struct sensor_lowerhalf_s *lower,
-                        FAR struct file *filep,
-                        FAR char *buffer, size_t buflen)
+int bme280_register(int devno, FAR struct i2c_master_s *i2c)
 {
-  DEBUGASSERT(lower != NULL);
-  DEBUGASSERT(buffer != NULL);
-  sninfo("buflen=%d\n", buflen);
-  int ret;
-  struct sensor_humi humi_data;
-
-  /* Get device struct */
+  return bme280_register_i2c(devno, i2c, BME280_ADDR, BME280_FREQ);
+}
 
-  FAR struct device *priv = container_of(lower,
-                                               FAR struct device,
-                                               sensor_humi);
-  sninfo("priv=%p, sensor_humi=%p\n", priv, lower); ////
+/****************************************************************************
+ * Name: bme280_register_i2c
+ *
+ * Description:
+ *   Register a BME280 character device at the given I2C address and
+ *   frequency
+ *
+ * Input Parameters:
+ *   devno   - Instance number for driver
+ *   i2c     - An instance of the I2C interface to use to communicate with
+ *             BME280
+ *   addr    - I2C address (0x76 or 0x77)
+ *   freq    - I2C frequency in Hz
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
 
-  /* Validate buffer size */
+int bme280_register_i2c(int devno, FAR struct i2c_master_s *i2c,
+                        uint8_t addr, uint32_t freq)
+{
+  DEBUGASSERT(i2c != NULL);
+  sninfo("devno=%d, addr=0x%02x, freq=%" PRIu32 "\n", devno, addr, freq);
+  union bme280_bus bus;
 
-  if (buflen != sizeof(humi_data))
+  if ((addr != BME280_I2C_ADDR_PRIMARY &&
+       addr != BME280_I2C_ADDR_SECONDARY) ||
+      freq == 0 || freq > BME280_FREQ_MAX)
     {
+      snerr("Invalid address 0x%02x or frequency %" PRIu32 "\n",
+            addr, freq);
       return -EINVAL;
     }
 
-  /* Fetch the sensor data */
+  bus.i2c.bus  = i2c;
+  bus.i2c.addr = addr;
+  bus.i2c.freq = freq;
 
-  ret = bme280_fetch(priv, NULL, &humi_data);
-  if (ret < 0)
+  return bme280_register_device(devno, &bme280_bus_io_i2c, &bus, NULL);
+}
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_register_spi
+ *
+ * Description:
+ *   Register a BME280 character device on an SPI Bus, selected with
+ *   SPIDEV_BAROMETER(devno)
+ *
+ * Input Parameters:
+ *   devno      - Instance number for driver
+ *   spi        - An instance of the SPI interface to use to communicate
+ *                with BME280
+ *   freq       - SPI frequency in Hz
+ *   three_wire - True for 3-wire SPI
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_register_spi(int devno, FAR struct spi_dev_s *spi,
+                        uint32_t freq, bool three_wire)
+{
+  DEBUGASSERT(spi != NULL);
+  sninfo("devno=%d, freq=%" PRIu32 ", three_wire=%d\n",
+         devno, freq, three_wire);
+  union bme280_bus bus;
+
+  if (freq == 0 || freq > BME280_SPI_FREQ_MAX)
     {
-      return ret;
+      snerr("Invalid frequency %" PRIu32 "\n", freq);
+      return -EINVAL;
     }
 
-  /* Return the sensor data */
+  bus.spi.bus        = spi;
+  bus.spi.devid      = SPIDEV_BAROMETER(devno);
+  bus.spi.freq       = freq;
+  bus.spi.three_wire = three_wire;
 
-  memcpy(buffer, &humi_data, sizeof(humi_data));
-  return buflen;
+  return bme280_register_device(devno, &bme280_bus_io_spi, &bus, NULL);
 }
+#endif /* CONFIG_SPI */
 
+#ifdef CONFIG_BME280_DUAL
 /****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-/****************************************************************************
- * Name: bme280_register
+ * Name: bme280_register_dual
  *
  * Description:
- *   Register the BME280 character device
+ *   Register two BME280s at 0x76 and 0x77 as one device in Dual Mode.
+ *   The sensor at 0x76 is registered, the sensor at 0x77 is its peer.
  *
  * Input Parameters:
  *   devno   - Instance number for driver
  *   i2c     - An instance of the I2C interface to use to communicate with
- *             BME280
+ *             both BME280s
+ *   freq    - I2C frequency in Hz
  *
  * Returned Value:
  *   Zero (OK) on success; a negated errno value on failure.
  *
  ****************************************************************************/
 
-int bme280_register(int devno, FAR struct i2c_master_s *i2c)
+int bme280_register_dual(int devno, FAR struct i2c_master_s *i2c,
+                         uint32_t freq)
 {
   DEBUGASSERT(i2c != NULL);
-  sninfo("devno=%d\n", devno);
-  FAR struct device *priv;
+  sninfo("devno=%d, freq=%" PRIu32 "\n", devno, freq);
+  FAR struct device *peer;
+  FAR struct bme280_data *data;
+  union bme280_bus bus;
   int ret;
 
-  /* Initialize the device structure */
-
-  priv = (FAR struct device *)kmm_zalloc(sizeof(struct device));
-  if (!priv)
+  if (freq == 0 || freq > BME280_FREQ_MAX)
     {
-      snerr("Failed to allocate instance\n");
-      return -ENOMEM;
+      return -EINVAL;
     }
-  sninfo("priv=%p, sensor_baro=%p, sensor_humi=%p\n", priv, &(priv->sensor_baro), &(priv->sensor_humi)); ////
 
-  /* Allocate the Compensation Parameters */
+  /* Initialize the second sensor, which is not registered */
 
-  struct bme280_data *data = (FAR struct bme280_data *)kmm_zalloc(sizeof(struct bme280_data));
-  if (!data)
+  peer = (FAR struct device *)kmm_zalloc(sizeof(struct device));
+  data = (FAR struct bme280_data *)kmm_zalloc(sizeof(struct bme280_data));
+  if (!peer || !data)
     {
-      snerr("Failed to allocate data\n");
-      kmm_free(priv);
-      return -ENOMEM;
+      snerr("Failed to allocate peer\n");
+      ret = -ENOMEM;
+      goto errout;
     }
 
-  priv->i2c  = i2c;
-  priv->addr = BME280_ADDR;
-  priv->freq = BME280_FREQ;
-  priv->name = "BME280";
-  priv->data = data;
-  priv->activated = true;
+  *data = (struct bme280_data)BME280_DATA_INIT;
 
-  /* Initialize the Barometer Sensor */
+  peer->bus.i2c.bus  = i2c;
+  peer->bus.i2c.addr = BME280_I2C_ADDR_SECONDARY;
+  peer->bus.i2c.freq = freq;
+  peer->bus_io = &bme280_bus_io_i2c;
+  peer->name = "BME280 (peer)";
+  peer->data = data;
+  peer->activated = true;
 
-  priv->sensor_baro.ops = &g_baro_ops;
-  priv->sensor_baro.type = SENSOR_TYPE_BAROMETER;
+#ifdef CONFIG_BME280_I2C_PROBE
+  ret = bme280_i2c_probe(peer);
+  if (ret >= 0)
+    {
+      ret = bme280_chip_init(peer);
+    }
+#else
+  ret = bme280_chip_init(peer);
+#endif
+  if (ret >= 0)
+    {
+      ret = bme280_pm_action(peer, PM_DEVICE_ACTION_SUSPEND);
+    }
 
-  /* Initialize the Humidity Sensor */
+  if (ret < 0)
+    {
+      snerr("Failed to init peer: %d\n", ret);
+      goto errout;
+    }
 
-  priv->sensor_humi.ops = &g_humi_ops;
-  priv->sensor_humi.type = SENSOR_TYPE_RELATIVE_HUMIDITY;
+  peer->activated = false;
 
-  /* Initialize the Sensor Hardware */
+  /* Register the first sensor with its peer */
 
-  ret = bme280_chip_init(priv);
-  if (ret < 0)
+  bus.i2c.bus  = i2c;
+  bus.i2c.addr = BME280_I2C_ADDR_PRIMARY;
+  bus.i2c.freq = freq;
+
+  ret = bme280_register_device(devno, &bme280_bus_io_i2c, &bus, peer);
+  if (ret >= 0)
     {
-      snerr("Failed to init: %d\n", ret);
-      kmm_free(data);
-      kmm_free(priv);
       return ret;
     }
 
-  /* Set power mode to sleep */
+errout:
+  kmm_free(data);
+  kmm_free(peer);
+  return ret;
+}
+#endif /* CONFIG_BME280_DUAL */
 
-  ret = bme280_pm_action(priv, PM_DEVICE_ACTION_SUSPEND);
-  if (ret < 0)
+#ifdef CONFIG_BME280_SCHEDULER
+/****************************************************************************
+ * Name: bme280_sample_bus
+ *
+ * Description:
+ *   Sample all active BME280s registered on an I2C Bus in one cycle.
+ *   Each sensor is locked only to start its conversion, and again to read
+ *   it, so the worker and callers may use it during the wait.  A read
+ *   waits for the latest conversion, so it never returns a half-done
+ *   sample.  Sensors in Dual Mode are skipped, as their worker owns the
+ *   timing of both conversions.
+ *
+ * Input Parameters:
+ *   i2c     - I2C Bus to sample, or NULL for all buses
+ *   cycle   - Returned timing of the cycle (may be NULL)
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value if any sensor failed.
+ *
+ ****************************************************************************/
+
+int bme280_sample_bus(FAR struct i2c_master_s *i2c,
+                      FAR struct bme280_cycle_s *cycle)
+{
+  FAR struct device *devs[CONFIG_BME280_SCHEDULER_NDEVICES];
+  FAR struct device *priv;
+  uint64_t ready = 0;
+  uint64_t start;
+  uint64_t trigger;
+  uint64_t wait;
+  uint64_t end;
+  int ret = OK;
+  int err;
+  int ndevs = 0;
+  int n = 0;
+  int i;
+
+  /* Take the sensors on the bus from the registry.  Drivers are never
+   * unloaded, so the devices stay valid after the registry is unlocked.
+   */
+
+  nxmutex_lock(&g_bme280_devices_lock);
+  for (i = 0; i < CONFIG_BME280_SCHEDULER_NDEVICES; i++)
     {
-      snerr("Failed to sleep: %d\n", ret);
-      kmm_free(data);
-      kmm_free(priv);
-      return ret;
+      priv = g_bme280_devices[i];
+      if (priv == NULL ||
+          (i2c != NULL && (priv->bus_io != &bme280_bus_io_i2c ||
+                           priv->bus.i2c.bus != i2c)))
+        {
+          continue;
+        }
+
+#ifdef CONFIG_BME280_DUAL
+      if (priv->peer != NULL)
+        {
+          continue;
+        }
+#endif
+
+      devs[ndevs++] = priv;
     }
-  priv->activated = false;
 
-  /* Register the Barometer Sensor */
+  nxmutex_unlock(&g_bme280_devices_lock);
+  start = bme280_now();
 
-  ret = sensor_register(&priv->sensor_baro, devno);
-  if (ret < 0)
+  /* Start the conversions of all active sensors on the bus */
+
+  for (i = 0; i < ndevs; i++)
     {
-      snerr("Failed to register barometer sensor: %d\n", ret);
-      kmm_free(data);
-      kmm_free(priv);
+      priv = devs[i];
+      bme280_lock(priv);
+      err = priv->activated ? bme280_sample_start(priv) : -EAGAIN;
+      if (err >= 0 && priv->data->ready_us > ready)
+        {
+          ready = priv->data->ready_us;
+        }
+
+      bme280_unlock(priv);
+      if (err < 0)
+        {
+          if (err != -EAGAIN && ret >= 0)
+            {
+              ret = err;
+            }
+
+          continue;
+        }
+
+      devs[n++] = priv;
     }
 
-  /* Register the Humidity Sensor */
+  /* Wait once for the longest conversion */
 
-  ret = sensor_register(&priv->sensor_humi, devno);
-  if (ret < 0)
+  trigger = bme280_now();
+  if (trigger < ready)
     {
-      snerr("Failed to register humidity sensor: %d\n", ret);
-      kmm_free(data);
-      kmm_free(priv);
+      usleep(ready - trigger);
     }
 
-  sninfo("BME280 driver loaded successfully!\n");
+  /* Read each sensor in one burst, unless it was suspended meanwhile */
+
+  wait = bme280_now();
+  for (i = 0; i < n; i++)
+    {
+      priv = devs[i];
+      bme280_lock(priv);
+      if (!priv->activated)
+        {
+          bme280_unlock(priv);
+          continue;
+        }
+
+      err = bme280_sample_read(priv);
+      if (err >= 0)
+        {
+          bme280_sample_save(priv);
+        }
+      else
+        {
+          priv->cached = false;
+          if (ret >= 0)
+            {
+              ret = err;
+            }
+        }
+
+      bme280_unlock(priv);
+    }
+
+  end = bme280_now();
+  if (cycle != NULL)
+    {
+      cycle->nsensors   = n;
+      cycle->trigger_us = trigger - start;
+      cycle->wait_us    = wait - trigger;
+      cycle->read_us    = end - wait;
+      cycle->total_us   = end - start;
+    }
+
+  sninfo("nsensors=%d, ret=%d\n", n, ret);
   return ret;
 }
+#endif /* CONFIG_BME280_SCHEDULER */
 
 #endif
@@ -26,6 +26,15 @@
  ****************************************************************************/
 
 #include <nuttx/config.h>
+#include <nuttx/sensors/ioctl.h>
+
+#ifdef CONFIG_BME280_TRACE
+#  include "trace.h"
+#endif
+
+#ifdef CONFIG_BME280_RECORD
+#  include "record.h"
+#endif
 
 #if defined(CONFIG_I2C) && (defined(CONFIG_SENSORS_BME280) || defined(CONFIG_SENSORS_BME280_SCU))
 
@@ -46,6 +55,119 @@
  ****************************************************************************/
 
 struct i2c_master_s;
+struct spi_dev_s;
+
+/* Oversampling, IIR filter and power mode for SNIOC_BME280_SETCTRL and
+ * SNIOC_BME280_GETCTRL
+ */
+
+struct bme280_ctrl_s
+{
+  uint8_t osrs_t;               /* Temperature oversampling BME280_OVERSAMP_* */
+  uint8_t osrs_p;               /* Pressure oversampling BME280_OVERSAMP_* */
+  uint8_t osrs_h;               /* Humidity oversampling BME280_OVERSAMP_* */
+  uint8_t filter;               /* IIR filter BME280_FILTER_COEFF_* */
+  uint8_t mode;                 /* BME280_OPMODE_NORMAL or _FORCED */
+};
+
+/* Sample in fixed-point for SNIOC_BME280_FETCH_FIXED */
+
+struct bme280_fixed_s
+{
+  uint64_t timestamp;           /* Time of sample in microseconds */
+  int32_t temperature;          /* Temperature in 0.01 degC */
+  uint32_t pressure;            /* Pressure in 1/256 Pa */
+  uint32_t humidity;            /* Relative humidity in 1/1024 %RH */
+};
+
+#ifdef CONFIG_BME280_SCHEDULER
+/* Timing of one sampling cycle for SNIOC_BME280_SAMPLE_BUS */
+
+struct bme280_cycle_s
+{
+  uint32_t nsensors;            /* Number of sensors sampled */
+  uint32_t trigger_us;          /* Time to start all conversions */
+  uint32_t wait_us;             /* Time waiting for the longest conversion */
+  uint32_t read_us;             /* Time to read and compensate all sensors */
+  uint32_t total_us;            /* Time of the whole cycle */
+};
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+/* Offset of the second sensor from the first in Dual Mode, for
+ * SNIOC_BME280_GET_OFFSET
+ */
+
+struct bme280_offset_s
+{
+  float temperature;            /* Temperature offset in degC */
+  float pressure;               /* Pressure offset in hPa */
+  float humidity;               /* Humidity offset in %RH */
+};
+#endif
+
+#ifdef CONFIG_BME280_STATS
+/* Number of buckets of the latency histograms.  Bucket 0 counts
+ * latencies under 1 ns, bucket n from 2^(n-1) to 2^n - 1 ns, and the
+ * last bucket everything above 2^30 ns.
+ */
+
+#define BME280_STATS_NBUCKETS 32
+
+/* Performance counters and latency histograms for SNIOC_BME280_GET_STATS */
+
+struct bme280_stats_s
+{
+  uint32_t transfers;           /* Bus transfers, including failed ones */
+  uint32_t bytes;               /* Register IDs and values transferred */
+  uint32_t errors;              /* Failed transfers */
+  uint32_t retries;             /* Transfers retried at a slower speed */
+  uint32_t waits;               /* Sleeps waiting for a measurement */
+  uint32_t samples;             /* Samples compensated */
+  uint32_t cache_hits;          /* Fetches served from latest sample */
+  uint32_t cache_misses;        /* Fetches that read the sensor */
+  uint32_t memo_hits;           /* Samples with an unchanged temperature */
+  uint32_t memo_misses;         /* Samples with a new temperature */
+  uint32_t bus_hist[BME280_STATS_NBUCKETS];   /* Latency per transfer */
+  uint32_t wait_hist[BME280_STATS_NBUCKETS];  /* Wait for measurement */
+  uint32_t comp_hist[BME280_STATS_NBUCKETS];  /* Compensation per sample */
+};
+#endif
+
+#ifdef CONFIG_BME280_TRACE
+/* Trace events for SNIOC_BME280_GET_TRACE */
+
+struct bme280_tracebuf_s
+{
+  FAR struct bme280_trace_s *events;  /* Buffer for the events */
+  uint32_t nevents;             /* In: size of buffer, out: events read */
+  uint32_t dropped;             /* Out: events overwritten before read */
+};
+#endif
+
+#ifdef CONFIG_BME280_RECORD
+/* Recorded raw frames for SNIOC_BME280_GET_RECORD */
+
+struct bme280_recordbuf_s
+{
+  struct bme280_record_header_s header;  /* Out: Chip ID and NVM */
+  FAR struct bme280_frame_s *frames;     /* Buffer for the frames */
+  uint32_t nframes;             /* In: size of buffer, out: frames read */
+  uint32_t dropped;             /* Out: frames overwritten before read */
+};
+#endif
+
+#ifdef CONFIG_SENSORS_BME280_SIM
+/* Bus statistics of the Simulated BME280 */
+
+struct bme280_sim_stats_s
+{
+  uint32_t transfers;           /* I2C_TRANSFER calls or SPI selects */
+  uint32_t messages;            /* Number of I2C messages or SPI blocks */
+  uint32_t bytes;               /* Number of data bytes */
+  uint32_t bits;                /* Number of bit times on the bus */
+};
+#endif
 
 /****************************************************************************
  * Public Function Prototypes
@@ -61,6 +183,91 @@ extern "C"
 
 /* IOCTL Commands ***********************************************************/
 
+/* Command:      SNIOC_BME280_REINIT
+ * Description:  Reset the chip and re-read the compensation parameters.
+ *               If the sensor is asleep, this happens on the next
+ *               activate instead.
+ * Argument:     None
+ */
+
+#define SNIOC_BME280_REINIT    _SNIOC(0x00f0)
+
+/* Command:      SNIOC_BME280_SETCTRL
+ * Description:  Set oversampling, IIR filter and power mode.  Only the
+ *               registers that change are written.
+ * Argument:     FAR const struct bme280_ctrl_s *
+ */
+
+#define SNIOC_BME280_SETCTRL   _SNIOC(0x00f1)
+
+/* Command:      SNIOC_BME280_GETCTRL
+ * Description:  Get oversampling, IIR filter and power mode
+ * Argument:     FAR struct bme280_ctrl_s *
+ */
+
+#define SNIOC_BME280_GETCTRL   _SNIOC(0x00f2)
+
+/* Command:      SNIOC_BME280_FETCH_FIXED
+ * Description:  Fetch the latest sample in fixed-point, without floats
+ * Argument:     FAR struct bme280_fixed_s *
+ */
+
+#define SNIOC_BME280_FETCH_FIXED _SNIOC(0x00f3)
+
+/* Command:      SNIOC_BME280_SAMPLE_BUS
+ * Description:  Sample all active BME280s on the bus of this sensor in one
+ *               cycle (CONFIG_BME280_SCHEDULER).  Each sensor keeps the
+ *               sample as its latest sample.
+ * Argument:     FAR struct bme280_cycle_s *
+ */
+
+#define SNIOC_BME280_SAMPLE_BUS _SNIOC(0x00f4)
+
+/* Command:      SNIOC_BME280_GET_OFFSET
+ * Description:  Get the offset of the second sensor from the first, as
+ *               calibrated in Dual Mode (CONFIG_BME280_DUAL)
+ * Argument:     FAR struct bme280_offset_s *
+ */
+
+#define SNIOC_BME280_GET_OFFSET _SNIOC(0x00f5)
+
+/* Command:      SNIOC_BME280_GET_STATS
+ * Description:  Get the performance counters and latency histograms
+ *               (CONFIG_BME280_STATS)
+ * Argument:     FAR struct bme280_stats_s *
+ */
+
+#define SNIOC_BME280_GET_STATS _SNIOC(0x00f6)
+
+/* Command:      SNIOC_BME280_RESET_STATS
+ * Description:  Clear the performance counters and latency histograms
+ *               (CONFIG_BME280_STATS)
+ * Argument:     None
+ */
+
+#define SNIOC_BME280_RESET_STATS _SNIOC(0x00f7)
+
+/* Command:      SNIOC_BME280_GET_TRACE
+ * Description:  Read the trace events recorded since the last read, oldest
+ *               first (CONFIG_BME280_TRACE)
+ * Argument:     FAR struct bme280_tracebuf_s *
+ */
+
+#define SNIOC_BME280_GET_TRACE _SNIOC(0x00f8)
+
+/* Command:      SNIOC_BME280_GET_RECORD
+ * Description:  Read the recording header and the raw frames recorded
+ *               since the last read, oldest first (CONFIG_BME280_RECORD)
+ * Argument:     FAR struct bme280_recordbuf_s *
+ */
+
+#define SNIOC_BME280_GET_RECORD _SNIOC(0x00f9)
+
+/* I2C address, selected by the SDO pin */
+
+#define BME280_I2C_ADDR_PRIMARY   (0x76) /* SDO to GND */
+#define BME280_I2C_ADDR_SECONDARY (0x77) /* SDO to VDDIO */
+
 /* Standby duration */
 
 #define BME280_STANDBY_05_MS   (0x00) /* 0.5 ms */
@@ -69,8 +276,32 @@ extern "C"
 #define BME280_STANDBY_250_MS  (0x03) /* 250 ms */
 #define BME280_STANDBY_500_MS  (0x04) /* 500 ms */
 #define BME280_STANDBY_1000_MS (0x05) /* 1000 ms */
-#define BME280_STANDBY_2000_MS (0x06) /* 2000 ms */
-#define BME280_STANDBY_4000_MS (0x07) /* 4000 ms */
+#define BME280_STANDBY_2000_MS (0x06) /* 2000 ms (BMP280) */
+#define BME280_STANDBY_4000_MS (0x07) /* 4000 ms (BMP280) */
+#define BME280_STANDBY_10_MS   (0x06) /* 10 ms (BME280) */
+#define BME280_STANDBY_20_MS   (0x07) /* 20 ms (BME280) */
+
+/* Oversampling of temperature, pressure and humidity */
+
+#define BME280_OVERSAMP_SKIPPED (0x00) /* Measurement skipped */
+#define BME280_OVERSAMP_1X     (0x01) /* Oversampling x1 */
+#define BME280_OVERSAMP_2X     (0x02) /* Oversampling x2 */
+#define BME280_OVERSAMP_4X     (0x03) /* Oversampling x4 */
+#define BME280_OVERSAMP_8X     (0x04) /* Oversampling x8 */
+#define BME280_OVERSAMP_16X    (0x05) /* Oversampling x16 */
+
+/* IIR filter coefficient */
+
+#define BME280_FILTER_COEFF_OFF (0x00) /* Filter off */
+#define BME280_FILTER_COEFF_2  (0x01) /* Coefficient 2 */
+#define BME280_FILTER_COEFF_4  (0x02) /* Coefficient 4 */
+#define BME280_FILTER_COEFF_8  (0x03) /* Coefficient 8 */
+#define BME280_FILTER_COEFF_16 (0x04) /* Coefficient 16 */
+
+/* Power mode when active */
+
+#define BME280_OPMODE_FORCED   (0x01) /* One measurement per fetch */
+#define BME280_OPMODE_NORMAL   (0x03) /* Continuous measurements */
 
 #ifdef CONFIG_SENSORS_BME280_SCU
 /****************************************************************************
@@ -95,7 +326,8 @@ int bme280_init(FAR struct i2c_master_s *i2c, int port);
  * Name: bme280_register
  *
  * Description:
- *   Register the BME280 character device
+ *   Register the BME280 character device at CONFIG_BME280_I2C_ADDRESS
+ *   (default 0x77) and CONFIG_BME280_I2C_FREQUENCY
  *
  * Input Parameters:
  *   devno   - Instance number for driver
@@ -114,6 +346,192 @@ int bme280temp_register(FAR const char *devpath, int minor,
                         FAR struct i2c_master_s *i2c, int port);
 #else
 int bme280_register(int devno, FAR struct i2c_master_s *i2c);
+
+/****************************************************************************
+ * Name: bme280_register_i2c
+ *
+ * Description:
+ *   Register a BME280 character device at the given I2C address and
+ *   frequency.  Each instance has its own state, so several sensors may
+ *   share one bus (at 0x76 and 0x77) or sit on different buses.  The
+ *   devno must be unique for each instance.
+ *
+ * Input Parameters:
+ *   devno   - Instance number for driver (uorb/sensor_baro<devno> and
+ *             uorb/sensor_humi<devno>)
+ *   i2c     - An instance of the I2C interface to use to communicate with
+ *             BME280
+ *   addr    - I2C address: BME280_I2C_ADDR_PRIMARY (0x76) or
+ *             BME280_I2C_ADDR_SECONDARY (0x77)
+ *   freq    - I2C frequency in Hz, at most 3.4 MHz.  With
+ *             CONFIG_BME280_I2C_PROBE, the fastest reliable speed up to
+ *             freq is probed.
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_register_i2c(int devno, FAR struct i2c_master_s *i2c,
+                        uint8_t addr, uint32_t freq);
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_register_spi
+ *
+ * Description:
+ *   Register a BME280 character device on an SPI Bus (CSB low at
+ *   power-up).  The board selects the sensor for
+ *   SPIDEV_BAROMETER(devno).  In 3-wire mode, SDI carries the data in
+ *   both directions and the SPI controller must be set up for it by the
+ *   board.
+ *
+ * Input Parameters:
+ *   devno      - Instance number for driver (uorb/sensor_baro<devno> and
+ *                uorb/sensor_humi<devno>)
+ *   spi        - An instance of the SPI interface to use to communicate
+ *                with BME280
+ *   freq       - SPI frequency in Hz, at most 10 MHz
+ *   three_wire - True for 3-wire SPI, false for 4-wire SPI
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_register_spi(int devno, FAR struct spi_dev_s *spi,
+                        uint32_t freq, bool three_wire);
+#endif
+#endif
+
+#ifdef CONFIG_BME280_DUAL
+/****************************************************************************
+ * Name: bme280_register_dual
+ *
+ * Description:
+ *   Register two BME280s on one I2C Bus, at 0x76 and 0x77, as one
+ *   Barometer and Humidity Sensor.  Both run in Normal Mode half a period
+ *   apart and are merged into one stream at twice the rate of each.  The
+ *   offset of the second sensor from the first is calibrated on the fly
+ *   and removed from its samples.
+ *
+ * Input Parameters:
+ *   devno   - Instance number for driver
+ *   i2c     - An instance of the I2C interface to use to communicate with
+ *             both BME280s
+ *   freq    - I2C frequency in Hz, at most 3.4 MHz
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_register_dual(int devno, FAR struct i2c_master_s *i2c,
+                         uint32_t freq);
+#endif
+
+#ifdef CONFIG_BME280_SCHEDULER
+/****************************************************************************
+ * Name: bme280_sample_bus
+ *
+ * Description:
+ *   Sample all active BME280s registered on an I2C Bus in one cycle:
+ *   start the Forced Mode conversions of all sensors, wait once for the
+ *   longest conversion, then read each sensor in one burst.  A cycle takes
+ *   about one conversion plus N reads, instead of N conversions.
+ *
+ * Input Parameters:
+ *   i2c     - I2C Bus to sample, or NULL for all buses
+ *   cycle   - Returned timing of the cycle (may be NULL)
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value if any sensor failed.
+ *
+ ****************************************************************************/
+
+int bme280_sample_bus(FAR struct i2c_master_s *i2c,
+                      FAR struct bme280_cycle_s *cycle);
+#endif
+
+#ifdef CONFIG_SENSORS_BME280_SIM
+/****************************************************************************
+ * Name: bme280_sim_initialize
+ *
+ * Description:
+ *   Create a simulated I2C Bus with two simulated BME280s, at addresses
+ *   0x76 and 0x77, for the NuttX Simulator.  Pass the returned I2C Master
+ *   to bme280_register or bme280_register_i2c.
+ *
+ * Returned Value:
+ *   The simulated I2C Master on success; NULL on failure.
+ *
+ ****************************************************************************/
+
+FAR struct i2c_master_s *bme280_sim_initialize(void);
+
+/****************************************************************************
+ * Name: bme280_sim_uninitialize
+ *
+ * Description:
+ *   Free the simulated I2C Bus
+ *
+ ****************************************************************************/
+
+void bme280_sim_uninitialize(FAR struct i2c_master_s *i2c);
+
+/****************************************************************************
+ * Name: bme280_sim_stats
+ *
+ * Description:
+ *   Get the bus statistics of the simulated I2C Bus
+ *
+ * Input Parameters:
+ *   i2c     - Simulated I2C Master from bme280_sim_initialize
+ *   stats   - Returned bus statistics
+ *   reset   - True to reset the statistics after reading
+ *
+ ****************************************************************************/
+
+void bme280_sim_stats(FAR struct i2c_master_s *i2c,
+                      FAR struct bme280_sim_stats_s *stats, bool reset);
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_sim_spi
+ *
+ * Description:
+ *   Get the simulated SPI Bus of the simulator, with a third simulated
+ *   BME280 on it.  Pass it to bme280_register_spi.  Its statistics are
+ *   counted with the I2C Bus in bme280_sim_stats.
+ *
+ * Input Parameters:
+ *   i2c     - Simulated I2C Master from bme280_sim_initialize
+ *
+ * Returned Value:
+ *   The simulated SPI Device.
+ *
+ ****************************************************************************/
+
+FAR struct spi_dev_s *bme280_sim_spi(FAR struct i2c_master_s *i2c);
+#endif
+
+/****************************************************************************
+ * Name: bme280_sim_benchmark
+ *
+ * Description:
+ *   Run the driver against a simulated BME280 and log the I2C transfers,
+ *   bytes, bus time and wall time per bme280_fetch
+ *
+ * Input Parameters:
+ *   iterations - Number of iterations (one Barometer and one Humidity
+ *                fetch per iteration)
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_sim_benchmark(int iterations);
 #endif
 
 #undef EXTERN
@@ -0,0 +1,78 @@
+/****************************************************************************
+ * drivers/sensors/bme280/record.h
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Recorded raw frames of the BME280 driver (CONFIG_BME280_RECORD).  A
+ * recording is a header with the Chip ID and the calibration NVM, followed
+ * by the raw data bursts, as written by a little-endian target.  The host
+ * replay tool (tools/bme280_replay.c) shares this layout with the driver,
+ * and compensates the frames with the code of compensate.h.  The layout
+ * is fixed here, so this header needs only <stdint.h>.
+ */
+
+#ifndef __DRIVERS_SENSORS_BME280_RECORD_H
+#define __DRIVERS_SENSORS_BME280_RECORD_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Magic of the recording header, with the format version */
+
+#define BME280_RECORD_MAGIC      "BME280R1"
+#define BME280_RECORD_MAGIC_SIZE 8
+
+/* Sizes in the recording, BME280_NVM_SIZE and BME280_RAW_SIZE of
+ * compensate.h
+ */
+
+#define BME280_RECORD_NVM_SIZE    32  /* Calibration NVM */
+#define BME280_RECORD_RAW_SIZE    8   /* Raw data burst */
+#define BME280_RECORD_HEADER_SIZE 44  /* struct bme280_record_header_s */
+#define BME280_RECORD_FRAME_SIZE  12  /* struct bme280_frame_s */
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Header of a recording, 44 bytes */
+
+struct bme280_record_header_s
+{
+  char magic[BME280_RECORD_MAGIC_SIZE];  /* BME280_RECORD_MAGIC */
+  uint8_t chip_id;              /* BME280_CHIP_ID or BMP280_CHIP_ID */
+  uint8_t reserved[3];          /* Zero */
+  uint8_t nvm[BME280_RECORD_NVM_SIZE];  /* Calibration NVM */
+};
+
+/* Raw data burst of one measurement, 12 bytes */
+
+struct bme280_frame_s
+{
+  uint32_t timestamp;           /* Time in microseconds, wraps in 71 min */
+  uint8_t raw[BME280_RECORD_RAW_SIZE];  /* Registers 0xF7 to 0xFE */
+};
+
+#endif /* __DRIVERS_SENSORS_BME280_RECORD_H */
@@ -0,0 +1,2860 @@
+/****************************************************************************
+ * drivers/sensors/bme280/sim.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Simulated BME280 for the NuttX Simulator (arch/sim on Linux).
+ *
+ * The simulated sensor sits behind an I2C Master, so the driver runs
+ * unchanged: every bme280_reg_read / bme280_reg_write goes through
+ * I2C_TRANSFER into the simulated Register File below.  The simulator
+ * counts the I2C transfers, messages and bytes that the driver sends,
+ * so we can measure changes to the driver without a board.  With
+ * CONFIG_SPI, one more simulated sensor sits behind an SPI Device.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <nuttx/nuttx.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/clock.h>
+#include <nuttx/i2c/i2c_master.h>
+#include <nuttx/sensors/bme280.h>
+
+#ifdef CONFIG_SPI
+#  include <nuttx/spi/spi.h>
+#endif
+
+#if defined(CONFIG_I2C) && defined(CONFIG_SENSORS_BME280) && \
+    defined(CONFIG_SENSORS_BME280_SIM)
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BME280_SIM_ADDR       0x77    /* I2C address of benchmarked sensor */
+#define BME280_SIM_NCHIPS     2       /* Simulated sensors at 0x76 and 0x77 */
+#define BME280_SIM_NVM_US     2000    /* Time to copy NVM after reset */
+#define BME280_SIM_CONVERSIONS 100000 /* Iterations of conversion benchmark */
+#define BME280_SIM_BATCH      256     /* Samples per batch compensation */
+#define BME280_SIM_SPI_FREQ   10000000 /* SPI frequency of benchmark */
+#define BME280_SIM_FREQ_MAX   1000000 /* Fastest reliable I2C frequency */
+#define BME280_SIM_TRACES     1000    /* Iterations of trace benchmark */
+#define BME280_SIM_HPA_MIN    900.0f  /* Plausible range of the pressure */
+#define BME280_SIM_HPA_MAX    1100.0f
+#define BME280_SIM_DUAL_TOLERANCE 10  /* Dual Mode interval error (%) */
+#define BME280_SIM_DUAL_STAMP_US 1000 /* Dual Mode timestamp error (us) */
+#define BME280_SIM_DUAL_OUTLIERS 4    /* Two late host wakes, two each */
+#define BME280_SIM_JITTER_US  100     /* Jitter of each measurement phase */
+#define BME280_SIM_NDONE      64      /* Completion times logged per chip */
+
+/* Oscillator error of the sensors at 0x76 and 0x77 in parts per million,
+ * applied to the measurement and standby times
+ */
+
+#define BME280_SIM_SKEW0      (-6000)
+#define BME280_SIM_SKEW1      4000
+
+/* Expected transfers of the driver: the init reads the Chip ID, writes
+ * the Soft Reset, polls the Status, reads the Calibration NVM in 3 bursts
+ * and writes the control registers at once.  A fetch in Forced Mode
+ * triggers and reads one burst.  CONFIG_BME280_VERIFY_CTRL reads back each
+ * control write.
+ */
+
+#ifdef CONFIG_BME280_VERIFY_CTRL
+#  define BME280_SIM_VERIFY   1
+#else
+#  define BME280_SIM_VERIFY   0
+#endif
+
+#define BME280_SIM_INIT_TRANSFERS   (7 + BME280_SIM_VERIFY)
+#define BME280_SIM_FORCED_TRANSFERS (2 + BME280_SIM_VERIFY)
+
+/* Registration also puts the sensor to sleep with one control write.
+ * CONFIG_BME280_I2C_PROBE reads the Chip ID and the Calibration NVM at
+ * each I2C speed up to the requested frequency first.
+ */
+
+#ifdef CONFIG_BME280_I2C_PROBE
+#  define BME280_SIM_PROBE_TRANSFERS (2 * BME280_I2C_NSPEEDS)
+#else
+#  define BME280_SIM_PROBE_TRANSFERS 0
+#endif
+
+#define BME280_SIM_REGISTER_TRANSFERS \
+  (BME280_SIM_INIT_TRANSFERS + 1 + BME280_SIM_VERIFY)
+
+/* Device numbers of the benchmarked sensors, clear of baro0 and humi0
+ * registered by sim_bringup
+ */
+
+#define BME280_SIM_DEVNO      10      /* Sensor at 0x77 */
+#define BME280_SIM_DEVNO2     11      /* Sensor at 0x76 */
+#define BME280_SIM_DEVNO_SPI  12      /* Sensor on the SPI Bus */
+#define BME280_SIM_DEVNO_DUAL 13      /* Sensors at 0x76 and 0x77 in Dual */
+
+/* Raw ADC values of the simulated environment (about 25 degC,
+ * 1006 hPa, 50 %RH with the calibration below)
+ */
+
+#define BME280_SIM_ADC_TEMP   519888
+#define BME280_SIM_ADC_PRESS  415148
+#define BME280_SIM_ADC_HUMI   27500
+
+/* Pressure and humidity ADC bias of the sensor at 0x76 against the sensor
+ * at 0x77, so that the two sensors of Dual Mode disagree slightly
+ */
+
+#define BME280_SIM_ADC_BIAS   64
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Simulated BME280 */
+
+struct bme280_sim_s
+{
+  uint8_t regs[256];            /* Register File */
+  uint8_t ptr;                  /* Register Pointer */
+  uint8_t ctrl_hum;             /* CTRL_HUM latched by CTRL_MEAS write */
+  uint64_t nvm_done;            /* Time when NVM copy completes (us) */
+  uint64_t meas_start;          /* Start of the current measurement (us) */
+  uint64_t meas_done;           /* End of the current measurement (us) */
+  uint32_t meas_count;          /* Number of completed measurements */
+  uint32_t adc_bias;            /* Bias of pressure and humidity ADC */
+  int32_t skew;                 /* Oscillator error (ppm) */
+  uint32_t seed;                /* State of the jitter generator */
+  uint64_t done[BME280_SIM_NDONE];  /* Completion times, circular */
+  uint32_t ndone;               /* Number of completion times logged */
+};
+
+/* Simulated I2C Bus with a BME280 at each address */
+
+struct bme280_sim_bus_s
+{
+  struct i2c_master_s dev;      /* Simulated I2C Master (must be first) */
+  struct bme280_sim_s chip[BME280_SIM_NCHIPS];  /* At 0x76 and 0x77 */
+  struct bme280_sim_stats_s stats;  /* Bus statistics */
+  uint32_t freq_max;            /* Fastest reliable I2C frequency */
+
+#ifdef CONFIG_SPI
+  /* Simulated SPI Bus with one more BME280 */
+
+  struct spi_dev_s spi;         /* Simulated SPI Device */
+  struct bme280_sim_s spi_chip; /* BME280 on the SPI Bus */
+  bool spi_three_wire;          /* SDO not connected, data on SDI */
+  bool spi_control;             /* Next byte is a Control Byte */
+  bool spi_read;                /* Reading from the Register Pointer */
+#endif
+};
+
+/* Logged raw samples and their compensated values */
+
+struct bme280_sim_batch_s
+{
+  int32_t adc_temp[BME280_SIM_BATCH];
+  int32_t adc_press[BME280_SIM_BATCH];
+  int32_t adc_humi[BME280_SIM_BATCH];
+  int32_t temp[BME280_SIM_BATCH];
+  uint32_t press[BME280_SIM_BATCH];
+  uint32_t humi[BME280_SIM_BATCH];
+};
+
+#ifdef CONFIG_BME280_PUSH_MODE
+/* Samples pushed to the Barometer or Humidity Sensor */
+
+struct bme280_sim_push_s
+{
+  size_t size;                  /* Size of a sample */
+  size_t bytes;                 /* Bytes pushed */
+  uint32_t events;              /* Push events */
+  uint64_t last;                /* Timestamp of the last sample */
+  bool unordered;               /* A sample was older than the last */
+};
+#endif
+
+/* State of the benchmark, shared by its steps */
+
+struct bme280_sim_bench_s
+{
+  FAR struct i2c_master_s *i2c; /* Simulated I2C Bus */
+  int iterations;               /* Iterations of the fetch benchmarks */
+  uint32_t init_transfers;      /* Transfers of the registration */
+  FAR struct device *priv;      /* Benchmarked sensor at 0x77 */
+  FAR struct device *priv2;     /* Second sensor at 0x76 */
+#ifdef CONFIG_BME280_DUAL
+  FAR struct device *dual;      /* Sensors at 0x76 and 0x77 in Dual Mode */
+#endif
+#ifdef CONFIG_BME280_PUSH_MODE
+  struct bme280_sim_push_s pushed[2];  /* To Barometer and Humidity */
+#endif
+#ifdef CONFIG_BME280_RECORD
+  struct bme280_frame_s frames[CONFIG_BME280_RECORD_SIZE];
+  struct bme280_recordbuf_s recordbuf;
+#endif
+#ifdef CONFIG_BME280_TRACE
+  struct bme280_trace_s events[CONFIG_BME280_TRACE_SIZE];
+  struct bme280_tracebuf_s tracebuf;
+#endif
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int bme280_sim_transfer(FAR struct i2c_master_s *dev,
+                               FAR struct i2c_msg_s *msgs, int count);
+#ifdef CONFIG_SPI
+static int bme280_sim_spi_lock(FAR struct spi_dev_s *dev, bool lock);
+static void bme280_sim_spi_select(FAR struct spi_dev_s *dev,
+                                  uint32_t devid, bool selected);
+static uint32_t bme280_sim_spi_setfrequency(FAR struct spi_dev_s *dev,
+                                            uint32_t frequency);
+static uint8_t bme280_sim_spi_status(FAR struct spi_dev_s *dev,
+                                     uint32_t devid);
+static uint32_t bme280_sim_spi_send(FAR struct spi_dev_s *dev, uint32_t wd);
+static void bme280_sim_spi_exchange(FAR struct spi_dev_s *dev,
+                                    FAR const void *txbuffer,
+                                    FAR void *rxbuffer, size_t nwords);
+#ifndef CONFIG_SPI_EXCHANGE
+static void bme280_sim_spi_sndblock(FAR struct spi_dev_s *dev,
+                                    FAR const void *txbuffer,
+                                    size_t nwords);
+static void bme280_sim_spi_recvblock(FAR struct spi_dev_s *dev,
+                                     FAR void *rxbuffer, size_t nwords);
+#endif
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* I2C Operations for the Simulated BME280 */
+
+static const struct i2c_ops_s g_bme280_sim_ops =
+{
+  .transfer = bme280_sim_transfer,
+};
+
+#ifdef CONFIG_SPI
+/* SPI Operations for the Simulated BME280 */
+
+static const struct spi_ops_s g_bme280_sim_spi_ops =
+{
+  .lock         = bme280_sim_spi_lock,
+  .select       = bme280_sim_spi_select,
+  .setfrequency = bme280_sim_spi_setfrequency,
+  .status       = bme280_sim_spi_status,
+  .send         = bme280_sim_spi_send,
+#ifdef CONFIG_SPI_EXCHANGE
+  .exchange     = bme280_sim_spi_exchange,
+#else
+  .sndblock     = bme280_sim_spi_sndblock,
+  .recvblock    = bme280_sim_spi_recvblock,
+#endif
+};
+#endif
+
+/* Forced Mode with 1x oversampling */
+
+static const struct bme280_ctrl_s g_bme280_sim_forced =
+{
+  BME280_OVERSAMP_1X, BME280_OVERSAMP_1X, BME280_OVERSAMP_1X,
+  BME280_FILTER_COEFF_OFF, BME280_OPMODE_FORCED
+};
+
+#ifdef CONFIG_BME280_DUAL
+/* Normal Mode with 1x oversampling */
+
+static const struct bme280_ctrl_s g_bme280_sim_normal =
+{
+  BME280_OVERSAMP_1X, BME280_OVERSAMP_1X, BME280_OVERSAMP_1X,
+  BME280_FILTER_COEFF_OFF, BME280_OPMODE_NORMAL
+};
+#endif
+
+/* Calibration NVM at 0x88 (dig_T1 to dig_P9, then reserved and dig_H1)
+ * and at 0xE1 (dig_H2 to dig_H6).  Temperature and pressure coefficients
+ * are the example values from the BMP280 Datasheet (Section 3.12),
+ * humidity coefficients are typical values of a BME280.
+ */
+
+static const uint8_t g_bme280_sim_nvm1[26] =
+{
+  0x70, 0x6b, 0x43, 0x67, 0x18, 0xfc, 0x7d, 0x8e,
+  0x43, 0xd6, 0xd0, 0x0b, 0x27, 0x0b, 0x8c, 0x00,
+  0xf9, 0xff, 0x8c, 0x3c, 0xf8, 0xc6, 0x70, 0x17,
+  0x00, 0x4b
+};
+
+static const uint8_t g_bme280_sim_nvm2[7] =
+{
+  0x6a, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1e
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: bme280_sim_now
+ *
+ * Description:
+ *   Return the current time in microseconds
+ *
+ ****************************************************************************/
+
+static uint64_t bme280_sim_now(void)
+{
+  struct timespec ts;
+
+  clock_systime_timespec(&ts);
+  return 1000000ull * ts.tv_sec + ts.tv_nsec / 1000;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_oversampling
+ *
+ * Description:
+ *   Convert an osrs_x field to the number of oversampled conversions
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_oversampling(uint8_t osrs)
+{
+  return (osrs == 0) ? 0 : (osrs >= 5) ? 16 : (1 << (osrs - 1));
+}
+
+/****************************************************************************
+ * Name: bme280_sim_meas_time
+ *
+ * Description:
+ *   Return the typical measurement time in microseconds for the latched
+ *   oversampling settings (BME280 Datasheet, Section 9.1).  The driver
+ *   waits for the maximum, which is about 15% longer.
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_meas_time(FAR struct bme280_sim_s *sim)
+{
+  uint8_t ctrl_meas = sim->regs[BME280_REG_CTRL_MEAS];
+  uint32_t osrs_t = bme280_sim_oversampling((ctrl_meas >> 5) & 0x07);
+  uint32_t osrs_p = bme280_sim_oversampling((ctrl_meas >> 2) & 0x07);
+  uint32_t osrs_h = bme280_sim_oversampling(sim->ctrl_hum & 0x07);
+  uint32_t t = 1000 + 2000 * osrs_t;
+
+  if (osrs_p != 0)
+    {
+      t += 2000 * osrs_p + 500;
+    }
+
+  if (osrs_h != 0)
+    {
+      t += 2000 * osrs_h + 500;
+    }
+
+  return t;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_standby_time
+ *
+ * Description:
+ *   Return the standby time in microseconds (BME280 Datasheet, Table 27)
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_standby_time(FAR struct bme280_sim_s *sim)
+{
+  static const uint32_t t_sb[8] =
+  {
+    500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000
+  };
+
+  return t_sb[(sim->regs[BME280_REG_CONFIG] >> 5) & 0x07];
+}
+
+/****************************************************************************
+ * Name: bme280_sim_skew
+ *
+ * Description:
+ *   Apply the oscillator error of the simulated sensor to a nominal time,
+ *   plus a random jitter of up to BME280_SIM_JITTER_US
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_skew(FAR struct bme280_sim_s *sim, uint32_t t)
+{
+  int32_t jitter;
+
+  sim->seed  = sim->seed * 1103515245 + 12345;
+  jitter     = (int32_t)((sim->seed >> 16) % (2 * BME280_SIM_JITTER_US + 1))
+               - BME280_SIM_JITTER_US;
+  return t + (int32_t)((int64_t)t * sim->skew / 1000000) + jitter;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_latch
+ *
+ * Description:
+ *   Complete a measurement and update the Data Registers 0xF7 to 0xFE.
+ *   The simulated environment drifts slowly so that consecutive samples
+ *   are not all identical.
+ *
+ ****************************************************************************/
+
+static void bme280_sim_latch(FAR struct bme280_sim_s *sim)
+{
+  FAR uint8_t *data = &sim->regs[BME280_REG_PRESS_MSB];
+  uint8_t ctrl_meas = sim->regs[BME280_REG_CTRL_MEAS];
+  uint32_t n = sim->meas_count++;
+
+  sim->done[sim->ndone++ % BME280_SIM_NDONE] = sim->meas_done;
+  uint32_t adc_press = 0x80000;
+  uint32_t adc_temp = 0x80000;
+  uint32_t adc_humi = 0x8000;
+
+  if (((ctrl_meas >> 5) & 0x07) != 0)
+    {
+      adc_temp = BME280_SIM_ADC_TEMP + ((n >> 3) & 0x0f);
+    }
+
+  if (((ctrl_meas >> 2) & 0x07) != 0)
+    {
+      adc_press = BME280_SIM_ADC_PRESS + (n & 0x1f) + sim->adc_bias;
+    }
+
+  if ((sim->ctrl_hum & 0x07) != 0)
+    {
+      adc_humi = BME280_SIM_ADC_HUMI + ((n >> 1) & 0x07) + sim->adc_bias;
+    }
+
+  data[0] = adc_press >> 12;
+  data[1] = adc_press >> 4;
+  data[2] = (adc_press & 0x0f) << 4;
+  data[3] = adc_temp >> 12;
+  data[4] = adc_temp >> 4;
+  data[5] = (adc_temp & 0x0f) << 4;
+  data[6] = adc_humi >> 8;
+  data[7] = adc_humi;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_update
+ *
+ * Description:
+ *   Advance the simulated sensor to the current time: complete the NVM
+ *   copy and the measurements, and update the Status Register
+ *
+ ****************************************************************************/
+
+static void bme280_sim_update(FAR struct bme280_sim_s *sim)
+{
+  uint64_t now = bme280_sim_now();
+  uint8_t mode = sim->regs[BME280_REG_CTRL_MEAS] & 0x03;
+  uint8_t status = 0;
+
+  if (now < sim->nvm_done)
+    {
+      status |= BME280_STATUS_IM_UPDATE;
+    }
+
+  if (mode == BME280_MODE_FORCED)
+    {
+      /* Forced Mode: One measurement, then back to Sleep Mode */
+
+      if (now >= sim->meas_done)
+        {
+          bme280_sim_latch(sim);
+          sim->regs[BME280_REG_CTRL_MEAS] &= ~0x03;
+        }
+      else
+        {
+          status |= BME280_STATUS_MEASURING;
+        }
+    }
+  else if (mode == BME280_MODE_NORMAL)
+    {
+      /* Normal Mode: Measurement and Standby repeat forever, each with
+       * its own jitter.  Complete the cycles up to now.
+       */
+
+      while (now >= sim->meas_done)
+        {
+          bme280_sim_latch(sim);
+          sim->meas_start = sim->meas_done +
+                            bme280_sim_skew(sim,
+                                            bme280_sim_standby_time(sim));
+          sim->meas_done  = sim->meas_start +
+                            bme280_sim_skew(sim, bme280_sim_meas_time(sim));
+        }
+
+      if (now >= sim->meas_start)
+        {
+          status |= BME280_STATUS_MEASURING;
+        }
+    }
+
+  sim->regs[BME280_REG_STATUS] = status;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_reset
+ *
+ * Description:
+ *   Power-on Reset or Soft Reset of the simulated sensor
+ *
+ ****************************************************************************/
+
+static void bme280_sim_reset(FAR struct bme280_sim_s *sim)
+{
+  memset(sim->regs, 0, sizeof(sim->regs));
+  memcpy(&sim->regs[BME280_REG_COMP_START], g_bme280_sim_nvm1,
+         sizeof(g_bme280_sim_nvm1));
+  memcpy(&sim->regs[BME280_REG_HUM_COMP_PART2], g_bme280_sim_nvm2,
+         sizeof(g_bme280_sim_nvm2));
+
+  sim->regs[BME280_REG_ID] = BME280_CHIP_ID;
+  sim->regs[BME280_REG_PRESS_MSB]     = 0x80;  /* press_msb */
+  sim->regs[BME280_REG_PRESS_MSB + 3] = 0x80;  /* temp_msb */
+  sim->regs[BME280_REG_PRESS_MSB + 6] = 0x80;  /* hum_msb */
+
+  sim->ctrl_hum   = 0;
+  sim->meas_count = 0;
+  sim->nvm_done   = bme280_sim_now() + BME280_SIM_NVM_US;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_putreg
+ *
+ * Description:
+ *   Write a register of the simulated sensor
+ *
+ ****************************************************************************/
+
+static void bme280_sim_putreg(FAR struct bme280_sim_s *sim, uint8_t reg,
+                              uint8_t val)
+{
+  switch (reg)
+    {
+      case BME280_REG_RESET:
+        if (val == BME280_CMD_SOFT_RESET)
+          {
+            bme280_sim_reset(sim);
+          }
+        break;
+
+      case BME280_REG_CTRL_HUM:
+        sim->regs[reg] = val & 0x07;
+        break;
+
+      case BME280_REG_CTRL_MEAS:
+
+        /* CTRL_HUM becomes effective after writing CTRL_MEAS.  Any write
+         * restarts the measurement.
+         */
+
+        sim->regs[reg]  = val;
+        sim->ctrl_hum   = sim->regs[BME280_REG_CTRL_HUM];
+        sim->meas_start = bme280_sim_now();
+        sim->meas_done  = sim->meas_start +
+                          bme280_sim_skew(sim, bme280_sim_meas_time(sim));
+        break;
+
+      case BME280_REG_CONFIG:
+        sim->regs[reg] = val;
+        break;
+
+      default:
+
+        /* All other registers are read-only */
+
+        break;
+    }
+}
+
+/****************************************************************************
+ * Name: bme280_sim_transfer
+ *
+ * Description:
+ *   Called by I2C_TRANSFER to transfer I2C messages to the simulated
+ *   sensor.  A write message sets the Register Pointer, followed by pairs
+ *   of register and value.  A read message reads from the Register Pointer
+ *   with auto-increment.  Above freq_max, register writes are not
+ *   acknowledged and reads return corrupted bits.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_transfer(FAR struct i2c_master_s *dev,
+                               FAR struct i2c_msg_s *msgs, int count)
+{
+  FAR struct bme280_sim_bus_s *bus = (FAR struct bme280_sim_bus_s *)dev;
+  FAR struct bme280_sim_s *sim;
+  FAR struct i2c_msg_s *msg;
+  ssize_t i;
+  int n;
+
+  DEBUGASSERT(bus != NULL && msgs != NULL);
+  bus->stats.transfers++;
+
+  for (n = 0; n < count; n++)
+    {
+      msg = &msgs[n];
+      if (msg->addr != BME280_I2C_ADDR_PRIMARY &&
+          msg->addr != BME280_I2C_ADDR_SECONDARY)
+        {
+          /* No device at this address */
+
+          return -ENXIO;
+        }
+
+      sim = &bus->chip[msg->addr - BME280_I2C_ADDR_PRIMARY];
+
+      /* Address byte plus data bytes, 9 bits each with ACK, plus
+       * Start and Stop (or Repeated Start)
+       */
+
+      bus->stats.messages++;
+      bus->stats.bytes += msg->length;
+      bus->stats.bits  += 9 * (1 + msg->length) + 2;
+
+      bme280_sim_update(sim);
+      if (msg->flags & I2C_M_READ)
+        {
+          for (i = 0; i < msg->length; i++)
+            {
+              msg->buffer[i] = sim->regs[sim->ptr++];
+              if (msg->frequency > bus->freq_max)
+                {
+                  msg->buffer[i] ^= 0x01;
+                }
+            }
+        }
+      else if (msg->length > 1 && msg->frequency > bus->freq_max)
+        {
+          return -EIO;
+        }
+      else if (msg->length > 0)
+        {
+          sim->ptr = msg->buffer[0];
+          for (i = 1; i < msg->length; i += 2)
+            {
+              bme280_sim_putreg(sim, msg->buffer[i - 1], msg->buffer[i]);
+            }
+        }
+    }
+
+  return count;
+}
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_sim_spi_lock
+ *
+ * Description:
+ *   Lock the simulated SPI Bus.  Only one thread uses it.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_spi_lock(FAR struct spi_dev_s *dev, bool lock)
+{
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_select
+ *
+ * Description:
+ *   Set Chip Select of the simulated sensor.  A transaction starts with a
+ *   Control Byte.
+ *
+ ****************************************************************************/
+
+static void bme280_sim_spi_select(FAR struct spi_dev_s *dev,
+                                  uint32_t devid, bool selected)
+{
+  FAR struct bme280_sim_bus_s *bus =
+    container_of(dev, struct bme280_sim_bus_s, spi);
+
+  if (selected)
+    {
+      bus->stats.transfers++;
+      bus->spi_control = true;
+      bme280_sim_update(&bus->spi_chip);
+    }
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_setfrequency
+ *
+ * Description:
+ *   Set the SPI frequency.  The simulated sensor takes any frequency.
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_spi_setfrequency(FAR struct spi_dev_s *dev,
+                                            uint32_t frequency)
+{
+  return frequency;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_status
+ *
+ * Description:
+ *   Get the status of the SPI Device.  There's nothing to report.
+ *
+ ****************************************************************************/
+
+static uint8_t bme280_sim_spi_status(FAR struct spi_dev_s *dev,
+                                     uint32_t devid)
+{
+  return 0;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_send
+ *
+ * Description:
+ *   Exchange one byte with the simulated sensor
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_spi_send(FAR struct spi_dev_s *dev, uint32_t wd)
+{
+  uint8_t tx = wd;
+  uint8_t rx;
+
+  bme280_sim_spi_exchange(dev, &tx, &rx, 1);
+  return rx;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_exchange
+ *
+ * Description:
+ *   Exchange bytes with the simulated sensor (BME280 Datasheet, Section
+ *   6.3).  A Control Byte holds the R/W bit and bits 6:0 of the Register
+ *   ID.  A read continues with auto-increment, a write alternates values
+ *   and Control Bytes.  In 3-wire mode, the sensor drives no data until
+ *   spi3w_en is set in CONFIG.
+ *
+ ****************************************************************************/
+
+static void bme280_sim_spi_exchange(FAR struct spi_dev_s *dev,
+                                    FAR const void *txbuffer,
+                                    FAR void *rxbuffer, size_t nwords)
+{
+  FAR struct bme280_sim_bus_s *bus =
+    container_of(dev, struct bme280_sim_bus_s, spi);
+  FAR struct bme280_sim_s *sim = &bus->spi_chip;
+  FAR const uint8_t *tx = txbuffer;
+  FAR uint8_t *rx = rxbuffer;
+  uint8_t in;
+  uint8_t out;
+  size_t i;
+
+  bus->stats.messages++;
+  bus->stats.bytes += nwords;
+  bus->stats.bits  += 8 * nwords;
+
+  for (i = 0; i < nwords; i++)
+    {
+      in  = tx != NULL ? tx[i] : 0xff;
+      out = 0xff;
+
+      if (bus->spi_control)
+        {
+          sim->ptr = in | 0x80;
+          bus->spi_read = (in & 0x80) != 0;
+          bus->spi_control = false;
+        }
+      else if (bus->spi_read)
+        {
+          if (!bus->spi_three_wire ||
+              (sim->regs[BME280_REG_CONFIG] & BME280_SPI_3W_ENABLE) != 0)
+            {
+              out = sim->regs[sim->ptr];
+            }
+
+          sim->ptr++;
+        }
+      else
+        {
+          bme280_sim_putreg(sim, sim->ptr, in);
+          bus->spi_control = true;
+        }
+
+      if (rx != NULL)
+        {
+          rx[i] = out;
+        }
+    }
+}
+
+#ifndef CONFIG_SPI_EXCHANGE
+/****************************************************************************
+ * Name: bme280_sim_spi_sndblock
+ *
+ * Description:
+ *   Send bytes to the simulated sensor
+ *
+ ****************************************************************************/
+
+static void bme280_sim_spi_sndblock(FAR struct spi_dev_s *dev,
+                                    FAR const void *txbuffer,
+                                    size_t nwords)
+{
+  bme280_sim_spi_exchange(dev, txbuffer, NULL, nwords);
+}
+
+/****************************************************************************
+ * Name: bme280_sim_spi_recvblock
+ *
+ * Description:
+ *   Receive bytes from the simulated sensor
+ *
+ ****************************************************************************/
+
+static void bme280_sim_spi_recvblock(FAR struct spi_dev_s *dev,
+                                     FAR void *rxbuffer, size_t nwords)
+{
+  bme280_sim_spi_exchange(dev, NULL, rxbuffer, nwords);
+}
+#endif
+#endif /* CONFIG_SPI */
+
+#ifdef CONFIG_BME280_PUSH_MODE
+/****************************************************************************
+ * Name: bme280_sim_push
+ *
+ * Description:
+ *   Push Event of the sensor upper half, counts the push events and the
+ *   bytes pushed, and checks that the samples come in order of time
+ *
+ ****************************************************************************/
+
+static ssize_t bme280_sim_push(FAR void *priv, FAR const void *data,
+                               size_t bytes)
+{
+  FAR struct bme280_sim_push_s *pushed = priv;
+  FAR const uint8_t *sample = data;
+  uint64_t timestamp;
+  size_t i;
+
+  /* sensor_baro and sensor_humi both start with the timestamp */
+
+  for (i = 0; i + pushed->size <= bytes; i += pushed->size)
+    {
+      memcpy(&timestamp, &sample[i], sizeof(timestamp));
+      pushed->unordered |= timestamp < pushed->last;
+      pushed->last = timestamp;
+    }
+
+  pushed->bytes += bytes;
+  pushed->events++;
+  return bytes;
+}
+#endif
+
+#ifdef CONFIG_BME280_STATS
+/****************************************************************************
+ * Name: bme280_sim_hist
+ *
+ * Description:
+ *   Log the non-empty buckets of a latency histogram
+ *
+ ****************************************************************************/
+
+static void bme280_sim_hist(FAR const char *name, FAR const uint32_t *hist)
+{
+  int n;
+
+  for (n = 1; n < BME280_STATS_NBUCKETS; n++)
+    {
+      if (hist[n] != 0)
+        {
+          syslog(LOG_INFO, "bme280 stats %s: %" PRIu32 " from %" PRIu64
+                 " to %" PRIu64 " ns\n", name, hist[n],
+                 (uint64_t)1 << (n - 1), ((uint64_t)1 << n) - 1);
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: bme280_sim_ioctl
+ *
+ * Description:
+ *   Issue an IOCTL Command to a registered sensor through the control
+ *   operation of its Barometer Sensor, like the sensor upper half does
+ *   for ioctl()
+ *
+ ****************************************************************************/
+
+static int bme280_sim_ioctl(FAR struct device *priv, int cmd,
+                            unsigned long arg)
+{
+  return priv->sensor_baro.ops->control(&priv->sensor_baro, NULL, cmd,
+                                        arg);
+}
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_sim_bench_spi
+ *
+ * Description:
+ *   Register the BME280 on the simulated SPI Bus, and measure its fetches
+ *   in Normal Mode and in Forced Mode with 1x oversampling.  3-wire mode
+ *   costs two more transfers at init, to enable it before and after the
+ *   Soft Reset.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_spi(FAR struct bme280_sim_bench_s *bench,
+                                bool three_wire)
+{
+  FAR struct bme280_sim_bus_s *bus =
+    (FAR struct bme280_sim_bus_s *)bench->i2c;
+  FAR const char *wires = three_wire ? "3-wire" : "4-wire";
+  struct bme280_sim_stats_s stats;
+  FAR struct device *priv;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t limit;
+  int ret;
+  int i;
+
+  /* Power-on Reset, so 3-wire mode must be enabled again */
+
+  bme280_sim_reset(&bus->spi_chip);
+  bus->spi_chip.nvm_done = 0;
+  bus->spi_three_wire = three_wire;
+
+  start = bme280_sim_now();
+  ret = bme280_register_spi(BME280_SIM_DEVNO_SPI, &bus->spi,
+                            BME280_SIM_SPI_FREQ, three_wire);
+  elapsed = bme280_sim_now() - start;
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  priv = g_bme280_registered;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 spi %s init: chip 0x%02x, %" PRIu32
+         " transfers, %" PRIu32 " bytes, %" PRIu64 " us wall\n", wires,
+         priv->data->chip_id, stats.transfers, stats.bytes, elapsed);
+
+  /* One wait for the restart after Soft Reset, in 3-wire mode too */
+
+  limit = BME280_SIM_REGISTER_TRANSFERS + (three_wire ? 2 : 0);
+  if (priv->data->chip_id != BME280_CHIP_ID || stats.transfers > limit ||
+      elapsed >= 2 * BME280_STARTUP_US)
+    {
+      snerr("SPI %s init: chip 0x%02x in %" PRIu32 " transfers and %"
+            PRIu64 " us, expected 0x%02x in %" PRIu32 " and less than %d"
+            "\n", wires, priv->data->chip_id, stats.transfers, elapsed,
+            BME280_CHIP_ID, limit, 2 * BME280_STARTUP_US);
+      ret = -EIO;
+      goto errout;
+    }
+
+  /* The same fetches as over I2C, after the wake up and the first
+   * measurement
+   */
+
+  ret = bme280_activate(priv, true);
+  if (ret >= 0)
+    {
+      ret = bme280_fetch(priv, &baro, &humi);
+    }
+
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+
+  elapsed = 0;
+  for (i = 0; i < bench->iterations; i++)
+    {
+      usleep(CONFIG_BME280_CACHE_USEC);
+      start = bme280_sim_now();
+      ret = bme280_fetch(priv, &baro, NULL);
+      if (ret >= 0)
+        {
+          ret = bme280_fetch(priv, NULL, &humi);
+        }
+
+      if (ret < 0)
+        {
+          goto errout;
+        }
+
+      elapsed += bme280_sim_now() - start;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 spi %s fetch: %d fetches, per fetch: %" PRIu32
+         "/100 transfers, %" PRIu32 "/100 bytes, %" PRIu32
+         " us bus, %" PRIu64 " us wall\n", wires, 2 * bench->iterations,
+         100 * stats.transfers / (2 * bench->iterations),
+         100 * stats.bytes / (2 * bench->iterations),
+         (uint32_t)((uint64_t)stats.bits * 1000000 / BME280_SIM_SPI_FREQ /
+                    (2 * bench->iterations)),
+         elapsed / (2 * bench->iterations));
+
+  /* The Barometer and the Humidity Sensor share one burst read */
+
+  if (stats.transfers != bench->iterations)
+    {
+      snerr("SPI %s fetch: %" PRIu32 " transfers for %d iterations\n",
+            wires, stats.transfers, bench->iterations);
+      ret = -EIO;
+      goto errout;
+    }
+
+  /* A fetch in Forced Mode with 1x oversampling */
+
+  ret = bme280_sim_ioctl(priv, SNIOC_BME280_SETCTRL,
+                         (unsigned long)&g_bme280_sim_forced);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  start = bme280_sim_now();
+  ret = bme280_fetch(priv, &baro, &humi);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  elapsed = bme280_sim_now() - start;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 spi %s forced 1x fetch: %" PRIu32
+         " transfers, %" PRIu32 " bytes, %" PRIu32 " us bus, %" PRIu64
+         " us wall, %f hPa\n", wires, stats.transfers, stats.bytes,
+         (uint32_t)((uint64_t)stats.bits * 1000000 / BME280_SIM_SPI_FREQ),
+         elapsed, baro.pressure);
+
+  if (stats.transfers > BME280_SIM_FORCED_TRANSFERS)
+    {
+      snerr("SPI %s forced fetch: %" PRIu32 " transfers, expected %d\n",
+            wires, stats.transfers, BME280_SIM_FORCED_TRANSFERS);
+      ret = -EIO;
+    }
+
+errout:
+  bme280_unregister_device(priv, BME280_SIM_DEVNO_SPI);
+  return ret;
+}
+#endif /* CONFIG_SPI */
+
+/****************************************************************************
+ * Name: bme280_sim_bench_init
+ *
+ * Description:
+ *   Register the benchmarked sensor through bme280_register_i2c and
+ *   measure its init, then register the second sensor at 0x76 on the same
+ *   bus, with its own state.  Both are woken up like by their first
+ *   subscriber.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_init(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv;
+  FAR struct device *priv2;
+  struct bme280_sim_stats_s stats;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t limit;
+  int ret;
+
+  start = bme280_sim_now();
+  ret = bme280_register_i2c(BME280_SIM_DEVNO, bench->i2c, BME280_SIM_ADDR,
+                            CONFIG_BME280_I2C_FREQUENCY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  elapsed = bme280_sim_now() - start;
+  priv = bench->priv = g_bme280_registered;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 init: %" PRIu32 " transfers, %" PRIu32
+         " messages, %" PRIu32 " bytes, %" PRIu32 " us bus, %" PRIu64
+         " us wall\n",
+         stats.transfers, stats.messages, stats.bytes,
+         (uint32_t)((uint64_t)stats.bits * 1000000 / priv->bus.i2c.freq),
+         elapsed);
+
+  limit = BME280_SIM_REGISTER_TRANSFERS + BME280_SIM_PROBE_TRANSFERS;
+  if (priv->data->chip_id != BME280_CHIP_ID || stats.transfers > limit)
+    {
+      snerr("Init: chip 0x%02x in %" PRIu32 " transfers, expected 0x%02x "
+            "in %" PRIu32 "\n", priv->data->chip_id, stats.transfers,
+            BME280_CHIP_ID, limit);
+      return -EIO;
+    }
+
+  bench->init_transfers = stats.transfers;
+
+  ret = bme280_register_i2c(BME280_SIM_DEVNO2, bench->i2c,
+                            BME280_I2C_ADDR_PRIMARY,
+                            CONFIG_BME280_I2C_FREQUENCY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  priv2 = bench->priv2 = g_bme280_registered;
+  ret = bme280_activate(priv, true);
+  if (ret >= 0)
+    {
+      ret = bme280_activate(priv2, true);
+    }
+
+  if (ret >= 0)
+    {
+      ret = bme280_fetch(priv2, &baro, &humi);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 at 0x%02x: chip 0x%02x, %f hPa, %f degC, %f "
+         "%%RH\n", priv2->bus.i2c.addr, priv2->data->chip_id,
+         baro.pressure, baro.temperature, humi.humidity);
+
+  if (priv2->data->chip_id != BME280_CHIP_ID ||
+      baro.pressure < BME280_SIM_HPA_MIN ||
+      baro.pressure > BME280_SIM_HPA_MAX)
+    {
+      snerr("Sensor at 0x%02x: chip 0x%02x, %f hPa\n",
+            priv2->bus.i2c.addr, priv2->data->chip_id, baro.pressure);
+      return -EIO;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_bench_interval
+ *
+ * Description:
+ *   Measure set_interval with a new and with the same standby time, and
+ *   map intervals between the Standby Durations, ending at 500 ms.  The
+ *   same standby time must not be written again, and the sensor must
+ *   measure at least once per requested interval.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_interval(FAR struct bme280_sim_bench_s *bench)
+{
+  static const uint32_t intervals[3] =
+  {
+    100000, 5000000, 500000
+  };
+
+  FAR struct device *priv = bench->priv;
+  FAR struct bme280_sim_s *chip =
+    &((FAR struct bme280_sim_bus_s *)bench->i2c)->
+      chip[BME280_SIM_ADDR - BME280_I2C_ADDR_PRIMARY];
+  struct bme280_sim_stats_s stats;
+  unsigned long period;
+  uint32_t standby;
+  uint32_t t_meas;
+  uint32_t n;
+  int ret;
+  int i;
+
+  period = 500000;
+  ret = bme280_set_interval(priv, &period);
+  bme280_sim_stats(bench->i2c, &stats, true);
+  n = stats.transfers;
+  if (ret >= 0)
+    {
+      ret = bme280_set_interval(priv, &period);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 set_interval: %" PRIu32 " transfers (new), %"
+         PRIu32 " transfers (same)\n", n, stats.transfers);
+
+  if (n == 0 || stats.transfers != 0)
+    {
+      snerr("set_interval: %" PRIu32 " transfers (new), %" PRIu32
+            " transfers (same)\n", n, stats.transfers);
+      return -EIO;
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      period = intervals[i];
+      ret = bme280_set_interval(priv, &period);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      standby = bme280_sim_standby_time(chip);
+      t_meas  = bme280_meas_time_us(priv->data->ctrl_meas,
+                                    priv->data->ctrl_hum);
+      syslog(LOG_INFO, "bme280 interval %" PRIu32 " us: standby %" PRIu32
+             " us, measure %" PRIu32 " us, effective %lu us\n",
+             intervals[i], standby, t_meas, period);
+
+      if (standby + t_meas > intervals[i])
+        {
+          snerr("Interval %" PRIu32 " us: sensor period %" PRIu32 " us\n",
+                intervals[i], standby + t_meas);
+          return -EIO;
+        }
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_bench_resume
+ *
+ * Description:
+ *   Measure the suspend, resume and first fetch after resume.  The resume
+ *   restores the registers without a new init, and the first fetch waits
+ *   for the first measurement with one burst read.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_resume(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  struct bme280_sim_stats_s stats;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint64_t start;
+  uint64_t elapsed;
+  int ret;
+
+  start = bme280_sim_now();
+  ret = bme280_activate(priv, false);
+  if (ret >= 0)
+    {
+      ret = bme280_activate(priv, true);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  elapsed = bme280_sim_now() - start;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 suspend+resume: %" PRIu32 " transfers, %"
+         PRIu32 " messages, %" PRIu32 " bytes, %" PRIu64 " us wall\n",
+         stats.transfers, stats.messages, stats.bytes, elapsed);
+
+  if (stats.transfers >= bench->init_transfers)
+    {
+      snerr("Suspend+resume: %" PRIu32 " transfers, init takes %" PRIu32
+            "\n", stats.transfers, bench->init_transfers);
+      return -EIO;
+    }
+
+  start = bme280_sim_now();
+  ret = bme280_fetch(priv, &baro, &humi);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  elapsed = bme280_sim_now() - start;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 first fetch: %" PRIu32 " transfers, %" PRIu32
+         " bytes, %" PRIu64 " us wall\n",
+         stats.transfers, stats.bytes, elapsed);
+
+  if (stats.transfers != 1)
+    {
+      snerr("First fetch: %" PRIu32 " transfers, expected 1\n",
+            stats.transfers);
+      return -EIO;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_bench_fetch
+ *
+ * Description:
+ *   Measure the fetches.  Wait out the cache window between iterations,
+ *   like subscribers polling once per interval.  The Barometer and the
+ *   Humidity Sensor share one burst read per iteration, so the second
+ *   fetch is a cache hit (counted with CONFIG_BME280_STATS).
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_fetch(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  struct bme280_sim_stats_s stats;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t fetches;
+  int ret;
+  int i;
+
+#ifdef CONFIG_BME280_STATS
+  bme280_sim_ioctl(priv, SNIOC_BME280_RESET_STATS, 0);
+#endif
+#ifdef CONFIG_BME280_RECORD
+  bench->recordbuf.frames  = bench->frames;
+  bench->recordbuf.nframes = CONFIG_BME280_RECORD_SIZE;
+  bme280_sim_ioctl(priv, SNIOC_BME280_GET_RECORD,
+                   (unsigned long)&bench->recordbuf);
+#endif
+#ifdef CONFIG_BME280_TRACE
+  bench->tracebuf.events  = bench->events;
+  bench->tracebuf.nevents = CONFIG_BME280_TRACE_SIZE;
+  bme280_sim_ioctl(priv, SNIOC_BME280_GET_TRACE,
+                   (unsigned long)&bench->tracebuf);
+#endif
+
+  elapsed = 0;
+  for (i = 0; i < bench->iterations; i++)
+    {
+      usleep(CONFIG_BME280_CACHE_USEC);
+      start = bme280_sim_now();
+      ret = bme280_fetch(priv, &baro, NULL);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      ret = bme280_fetch(priv, NULL, &humi);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      elapsed += bme280_sim_now() - start;
+    }
+
+  fetches = 2 * bench->iterations;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 fetch: %" PRIu32 " fetches, per fetch: %" PRIu32
+         "/100 transfers, %" PRIu32 "/100 bytes, %" PRIu32
+         " us bus, %" PRIu64 " us wall\n",
+         fetches, 100 * stats.transfers / fetches,
+         100 * stats.bytes / fetches,
+         (uint32_t)((uint64_t)stats.bits * 1000000 / priv->bus.i2c.freq /
+                    fetches),
+         elapsed / fetches);
+
+  if (stats.transfers != bench->iterations)
+    {
+      snerr("Fetch: %" PRIu32 " transfers for %d iterations\n",
+            stats.transfers, bench->iterations);
+      return -EIO;
+    }
+
+  return OK;
+}
+
+#ifdef CONFIG_BME280_RECORD
+/****************************************************************************
+ * Name: bme280_sim_bench_record
+ *
+ * Description:
+ *   Replay the raw frames of the fetches through compensate.h, like
+ *   tools/bme280_replay.c.  The last frame must give the last sample of
+ *   the driver.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_record(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  FAR struct bme280_recordbuf_s *recordbuf = &bench->recordbuf;
+  struct bme280_calib calib;
+  struct bme280_coeffs coeffs;
+  int32_t adc[3];
+  int32_t comp[3];
+  int32_t t_fine;
+  uint32_t n;
+  bool same;
+  int ret;
+
+  recordbuf->nframes = CONFIG_BME280_RECORD_SIZE;
+  ret = bme280_sim_ioctl(priv, SNIOC_BME280_GET_RECORD,
+                         (unsigned long)recordbuf);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (recordbuf->nframes == 0)
+    {
+      snerr("Record: no frames\n");
+      return -EIO;
+    }
+
+  bme280_calib_parse(&calib, recordbuf->header.nvm);
+  bme280_coeffs_init(&coeffs, &calib);
+  for (n = 0; n < recordbuf->nframes; n++)
+    {
+      bme280_raw_decode(bench->frames[n].raw, &adc[0], &adc[1], &adc[2]);
+      t_fine  = bme280_comp_t_fine(&coeffs, adc[1]);
+      comp[0] = bme280_comp_temp(t_fine);
+      comp[1] = bme280_comp_press(&coeffs, t_fine, adc[0]);
+      comp[2] = bme280_comp_humidity(&coeffs, t_fine, adc[2]);
+    }
+
+  same = comp[0] == priv->fixed.temperature &&
+         (uint32_t)comp[1] == priv->fixed.pressure &&
+         (uint32_t)comp[2] == priv->fixed.humidity;
+  syslog(LOG_INFO, "bme280 record: %" PRIu32 " frames (%" PRIu32
+         " dropped), chip 0x%02x, replay %f hPa, %f degC, %f %%RH (%s)\n",
+         recordbuf->nframes, recordbuf->dropped, recordbuf->header.chip_id,
+         bme280_press_hpa(comp[1]), bme280_temp_degc(comp[0]),
+         bme280_humidity_rh(comp[2]), same ? "same" : "different");
+
+  if (!same)
+    {
+      snerr("Record: replay differs from the driver\n");
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_BME280_TRACE
+/****************************************************************************
+ * Name: bme280_sim_bench_trace
+ *
+ * Description:
+ *   Count the trace events of the fetches, and measure the cost of one
+ *   event.  Each iteration records one read, two fetches and one sample.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_trace(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  FAR struct bme280_tracebuf_s *tracebuf = &bench->tracebuf;
+  FAR struct bme280_trace_s *events = bench->events;
+  uint32_t nevents[BME280_TRACE_ACTIVATE + 1];
+  uint32_t expected = 4 * bench->iterations;
+  uint32_t recorded;
+  struct timespec ts;
+  clock_t perf;
+  uint32_t n;
+  int ret;
+
+  tracebuf->nevents = CONFIG_BME280_TRACE_SIZE;
+  ret = bme280_sim_ioctl(priv, SNIOC_BME280_GET_TRACE,
+                         (unsigned long)tracebuf);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  recorded = tracebuf->nevents + tracebuf->dropped;
+  memset(nevents, 0, sizeof(nevents));
+  for (n = 0; n < tracebuf->nevents; n++)
+    {
+      if (events[n].event <= BME280_TRACE_ACTIVATE)
+        {
+          nevents[events[n].event]++;
+        }
+    }
+
+  perf = perf_gettime();
+  for (n = 0; n < BME280_SIM_TRACES; n++)
+    {
+      bme280_trace(priv, BME280_TRACE_READ, BME280_REG_STATUS, 8, OK);
+    }
+
+  perf_convert(perf_gettime() - perf, &ts);
+  syslog(LOG_INFO, "bme280 trace: %" PRIu32 " events (%" PRIu32
+         " dropped), %" PRIu32 " reads, %" PRIu32 " writes, %" PRIu32
+         " fetches, %" PRIu32 " samples, %" PRIu64 " ns per event\n",
+         tracebuf->nevents, tracebuf->dropped,
+         nevents[BME280_TRACE_READ],
+         nevents[BME280_TRACE_WRITE] + nevents[BME280_TRACE_WRITE_MULTI],
+         nevents[BME280_TRACE_FETCH], nevents[BME280_TRACE_SAMPLE],
+         (1000000000ull * ts.tv_sec + ts.tv_nsec) / BME280_SIM_TRACES);
+
+  /* Discard the events of the trace benchmark */
+
+  tracebuf->nevents = CONFIG_BME280_TRACE_SIZE;
+  bme280_sim_ioctl(priv, SNIOC_BME280_GET_TRACE, (unsigned long)tracebuf);
+
+  /* Events are dropped when the trace is full, but all are counted */
+
+  if (recorded != expected ||
+      (recorded <= CONFIG_BME280_TRACE_SIZE &&
+       (nevents[BME280_TRACE_READ] != bench->iterations ||
+        nevents[BME280_TRACE_FETCH] != 2 * bench->iterations ||
+        nevents[BME280_TRACE_SAMPLE] != bench->iterations)))
+    {
+      snerr("Trace: %" PRIu32 " events, expected %" PRIu32 "\n",
+            recorded, expected);
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_BME280_STATS
+/****************************************************************************
+ * Name: bme280_sim_bench_stats
+ *
+ * Description:
+ *   The driver's own view of the fetches must match the simulated bus
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_stats(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  struct bme280_stats_s counters;
+  int ret;
+
+  ret = bme280_sim_ioctl(priv, SNIOC_BME280_GET_STATS,
+                         (unsigned long)&counters);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  syslog(LOG_INFO, "bme280 stats: %" PRIu32 " transfers, %" PRIu32
+         " bytes, %" PRIu32 " errors, %" PRIu32 " retries, %" PRIu32
+         " waits, %" PRIu32 " samples, %" PRIu32 " cache hits\n",
+         counters.transfers, counters.bytes, counters.errors,
+         counters.retries, counters.waits, counters.samples,
+         counters.cache_hits);
+  bme280_sim_hist("bus", counters.bus_hist);
+  bme280_sim_hist("wait", counters.wait_hist);
+  bme280_sim_hist("compensate", counters.comp_hist);
+
+  if (counters.transfers != bench->iterations || counters.errors != 0 ||
+      counters.samples != bench->iterations ||
+      counters.cache_hits != bench->iterations)
+    {
+      snerr("Stats: %" PRIu32 " transfers, %" PRIu32 " errors, %" PRIu32
+            " samples, %" PRIu32 " cache hits for %d iterations\n",
+            counters.transfers, counters.errors, counters.samples,
+            counters.cache_hits, bench->iterations);
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: bme280_sim_bench_forced
+ *
+ * Description:
+ *   Measure a fetch in Forced Mode with 1x oversampling: one trigger and
+ *   one burst read
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_forced(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  struct bme280_sim_stats_s stats;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint64_t start;
+  uint64_t elapsed;
+  int ret;
+
+  ret = bme280_sim_ioctl(priv, SNIOC_BME280_SETCTRL,
+                         (unsigned long)&g_bme280_sim_forced);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  start = bme280_sim_now();
+  ret = bme280_fetch(priv, &baro, &humi);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  elapsed = bme280_sim_now() - start;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 forced 1x fetch: %" PRIu32 " transfers, %"
+         PRIu32 " bytes, %" PRIu32 " us bus, %" PRIu64 " us wall\n",
+         stats.transfers, stats.bytes,
+         (uint32_t)((uint64_t)stats.bits * 1000000 / priv->bus.i2c.freq),
+         elapsed);
+  syslog(LOG_INFO, "bme280 last sample: %f hPa, %f degC, %f %%RH\n",
+         baro.pressure, baro.temperature, humi.humidity);
+
+  if (stats.transfers > BME280_SIM_FORCED_TRANSFERS)
+    {
+      snerr("Forced fetch: %" PRIu32 " transfers, expected %d\n",
+            stats.transfers, BME280_SIM_FORCED_TRANSFERS);
+      return -EIO;
+    }
+
+  return OK;
+}
+
+#ifdef CONFIG_BME280_I2C_PROBE
+/****************************************************************************
+ * Name: bme280_sim_bench_probe
+ *
+ * Description:
+ *   Probe the fastest I2C frequency up to High-speed mode, which must be
+ *   the reliable limit of the simulated bus, then fetch in Forced Mode at
+ *   1x.  Then slow down the simulated bus to Fast-mode: the next fetch
+ *   fails and must fall back to Fast-mode.  Once the bus is reliable
+ *   again and the reprobe time has passed, the next fetch must speed up
+ *   again.  A fetch from an absent address must fail in one transfer,
+ *   without a fallback.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_probe(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct bme280_sim_bus_s *bus =
+    (FAR struct bme280_sim_bus_s *)bench->i2c;
+  FAR struct device *priv = bench->priv;
+  struct bme280_sim_stats_s stats;
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  uint16_t addr;
+  int ret;
+
+  priv->bus.i2c.freq = I2C_SPEED_HIGH;
+  ret = bme280_i2c_probe(priv);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  usleep(CONFIG_BME280_CACHE_USEC);
+  bme280_sim_stats(bench->i2c, &stats, true);
+  ret = bme280_fetch(priv, &baro, &humi);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 probe: %" PRIu32 " Hz, forced 1x fetch: %"
+         PRIu32 " us bus\n", priv->bus.i2c.freq,
+         (uint32_t)((uint64_t)stats.bits * 1000000 / priv->bus.i2c.freq));
+
+  if (priv->bus.i2c.freq != BME280_SIM_FREQ_MAX)
+    {
+      snerr("Probe: %" PRIu32 " Hz, expected %d Hz\n", priv->bus.i2c.freq,
+            BME280_SIM_FREQ_MAX);
+      return -EIO;
+    }
+
+  bus->freq_max = I2C_SPEED_FAST;
+  usleep(CONFIG_BME280_CACHE_USEC);
+  ret = bme280_fetch(priv, &baro, &humi);
+  bus->freq_max = BME280_SIM_FREQ_MAX;
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  syslog(LOG_INFO, "bme280 fallback: %" PRIu32 " Hz after %" PRIu32
+         " fallbacks, %f hPa\n", priv->bus.i2c.freq, priv->freq_fallbacks,
+         baro.pressure);
+
+  if (priv->bus.i2c.freq != I2C_SPEED_FAST || priv->freq_fallbacks != 1)
+    {
+      snerr("Fallback: %" PRIu32 " Hz after %" PRIu32 " fallbacks, "
+            "expected %d Hz after 1\n", priv->bus.i2c.freq,
+            priv->freq_fallbacks, I2C_SPEED_FAST);
+      return -EIO;
+    }
+
+  /* As if the reprobe time had passed since the fallback */
+
+  priv->fallback_us = bme280_now() - CONFIG_BME280_I2C_REPROBE_USEC;
+  usleep(CONFIG_BME280_CACHE_USEC);
+  ret = bme280_fetch(priv, &baro, &humi);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  syslog(LOG_INFO, "bme280 reprobe: %" PRIu32 " Hz\n", priv->bus.i2c.freq);
+  if (priv->bus.i2c.freq != BME280_SIM_FREQ_MAX || priv->fallback_us != 0)
+    {
+      snerr("Reprobe: %" PRIu32 " Hz, expected %d Hz\n",
+            priv->bus.i2c.freq, BME280_SIM_FREQ_MAX);
+      return -EIO;
+    }
+
+  /* No sensor answers: -ENXIO at once, at the same frequency */
+
+  addr = priv->bus.i2c.addr;
+  priv->bus.i2c.addr = BME280_I2C_ADDR_PRIMARY - 1;
+  usleep(CONFIG_BME280_CACHE_USEC);
+  bme280_sim_stats(bench->i2c, &stats, true);
+  ret = bme280_fetch(priv, &baro, &humi);
+  priv->bus.i2c.addr = addr;
+  bme280_sim_stats(bench->i2c, &stats, true);
+  if (ret != -ENXIO || stats.transfers != 1 || priv->freq_fallbacks != 1 ||
+      priv->bus.i2c.freq != BME280_SIM_FREQ_MAX)
+    {
+      snerr("Absent sensor: %d after %" PRIu32 " transfers, %" PRIu32
+            " fallbacks, expected %d after 1 transfer and no fallback\n",
+            ret, stats.transfers, priv->freq_fallbacks, -ENXIO);
+      return -EIO;
+    }
+
+  priv->bus.i2c.freq = CONFIG_BME280_I2C_FREQUENCY;
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_BME280_SCHEDULER
+/****************************************************************************
+ * Name: bme280_sim_bench_scheduler
+ *
+ * Description:
+ *   Sample both sensors on the bus in Forced Mode at 1x, first one after
+ *   another, then in one pipelined cycle.  The cycle waits for the
+ *   conversions once, so reading the sensors after the wait must take
+ *   less than a conversion.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_scheduler(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  FAR struct device *priv2 = bench->priv2;
+  struct bme280_cycle_s cycle;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t t_meas;
+  int ret;
+
+  ret = bme280_sim_ioctl(priv2, SNIOC_BME280_SETCTRL,
+                         (unsigned long)&g_bme280_sim_forced);
+  start = bme280_sim_now();
+  if (ret >= 0)
+    {
+      ret = bme280_sample(priv);
+    }
+
+  if (ret >= 0)
+    {
+      ret = bme280_sample(priv2);
+    }
+
+  elapsed = bme280_sim_now() - start;
+  if (ret >= 0)
+    {
+      ret = bme280_sample_bus(bench->i2c, &cycle);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  syslog(LOG_INFO, "bme280 sample bus: %" PRIu32 " sensors, %" PRIu64
+         " us one by one, %" PRIu32 " us per cycle (trigger %" PRIu32
+         ", wait %" PRIu32 ", read %" PRIu32 ")\n", cycle.nsensors,
+         elapsed, cycle.total_us, cycle.trigger_us, cycle.wait_us,
+         cycle.read_us);
+
+  t_meas = bme280_meas_time_us(priv->data->ctrl_meas, priv->data->ctrl_hum);
+  if (cycle.nsensors != 2 || cycle.read_us >= t_meas)
+    {
+      snerr("Sample bus: %" PRIu32 " sensors, read %" PRIu32 " us after "
+            "the wait\n", cycle.nsensors, cycle.read_us);
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_BME280_WORKER
+/****************************************************************************
+ * Name: bme280_sim_bench_worker
+ *
+ * Description:
+ *   Measure a fetch from the ring buffer of the worker, sampling every
+ *   62.5 ms in the background.  Fetches from the ring must not touch the
+ *   bus, until the worker stalls for two intervals.  With Push Mode, count
+ *   the samples pushed in batches of 4, for a latency of 187.5 ms: one
+ *   push event per batch.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_worker(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct device *priv = bench->priv;
+  struct bme280_sim_stats_s stats;
+  struct bme280_sim_stats_s stale;
+  struct sensor_baro baro;
+  struct timespec ts;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t limit;
+  clock_t perf;
+#ifdef CONFIG_BME280_PUSH_MODE
+  FAR struct bme280_sim_push_s *pushed = bench->pushed;
+  unsigned long latency;
+  size_t samples;
+#endif
+  int ret;
+  int i;
+
+  priv->interval_us = 62500;
+
+#ifdef CONFIG_BME280_PUSH_MODE
+  memset(bench->pushed, 0, sizeof(bench->pushed));
+  pushed[0].size = sizeof(struct sensor_baro);
+  pushed[1].size = sizeof(struct sensor_humi);
+  priv->sensor_baro.push_event = bme280_sim_push;
+  priv->sensor_baro.priv = &pushed[0];
+  priv->sensor_humi.push_event = bme280_sim_push;
+  priv->sensor_humi.priv = &pushed[1];
+  latency = 187500;
+  bme280_set_batch(priv, &latency);
+#endif
+
+  ret = bme280_enable(priv, true);
+  for (i = 0; ret >= 0 && priv->ring_count == 0 && i < 1000; i++)
+    {
+      usleep(1000);
+    }
+
+  if (ret < 0 || priv->ring_count == 0)
+    {
+      return ret < 0 ? ret : -ETIMEDOUT;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  start = bme280_sim_now();
+  perf = perf_gettime();
+  for (i = 0; i < BME280_SIM_CONVERSIONS; i++)
+    {
+#ifdef CONFIG_BME280_PUSH_MODE
+      bme280_lock(priv);
+      ret = bme280_fetch(priv, &baro, NULL);
+      bme280_unlock(priv);
+#else
+      ret = bme280_fetch_baro(&priv->sensor_baro, NULL, (FAR char *)&baro,
+                              sizeof(baro));
+#endif
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  perf_convert(perf_gettime() - perf, &ts);
+  usleep(500000);
+  elapsed = bme280_sim_now() - start;
+  bme280_sim_stats(bench->i2c, &stats, true);
+
+  /* A stalled worker leaves its last sample in the ring.  Two intervals
+   * later, fetch must read the sensor instead.
+   */
+
+  bme280_lock(priv);
+  work_cancel(LPWORK, &priv->work);
+  bme280_unlock(priv);
+  usleep(2 * priv->interval_us + 20000);
+  bme280_lock(priv);
+  ret = bme280_fetch(priv, &baro, NULL);
+  bme280_unlock(priv);
+  bme280_sim_stats(bench->i2c, &stale, true);
+  if (ret >= 0 && stale.transfers == 0)
+    {
+      snerr("Worker: fetch returned a sample of %" PRIu64 " us ago\n",
+            bme280_now() - baro.timestamp);
+      ret = -EIO;
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = bme280_enable(priv, false);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  syslog(LOG_INFO, "bme280 worker fetch: %" PRIu64 " ns per fetch, %"
+         PRIu32 " transfers in background over %" PRIu64 " ms, %d in ring\n",
+         (1000000000ull * ts.tv_sec + ts.tv_nsec) / BME280_SIM_CONVERSIONS,
+         stats.transfers, elapsed / 1000, priv->ring_count);
+
+  /* Only the worker reads the sensor, once per interval */
+
+  limit = BME280_SIM_FORCED_TRANSFERS *
+          (uint32_t)(elapsed / priv->interval_us + 2);
+  if (stats.transfers > limit)
+    {
+      snerr("Worker: %" PRIu32 " transfers over %" PRIu64 " ms, expected "
+            "at most %" PRIu32 "\n", stats.transfers, elapsed / 1000,
+            limit);
+      return -EIO;
+    }
+
+#ifdef CONFIG_BME280_PUSH_MODE
+  samples = pushed[0].bytes / sizeof(struct sensor_baro);
+  syslog(LOG_INFO, "bme280 push: %zu baro and %zu humi samples in %"
+         PRIu32 " batches, %" PRIu32 " push events per sensor, latency %lu "
+         "us\n", samples, pushed[1].bytes / sizeof(struct sensor_humi),
+         priv->push_events, pushed[0].events, latency);
+
+  /* Full batches, plus the rest when the worker stops.  Each batch is
+   * pushed from the ring in one push event, or two when it wraps around.
+   */
+
+  if (samples == 0 ||
+      samples != pushed[1].bytes / sizeof(struct sensor_humi) ||
+      priv->push_events !=
+        (samples + priv->batch_size - 1) / priv->batch_size ||
+      pushed[0].events < priv->push_events ||
+      pushed[0].events > 2 * priv->push_events ||
+      pushed[1].events != pushed[0].events ||
+      pushed[0].unordered || pushed[1].unordered)
+    {
+      snerr("Push: %zu samples in %" PRIu32 " batches, %" PRIu32 " push "
+            "events, batches of %d\n", samples, priv->push_events,
+            pushed[0].events, priv->batch_size);
+      return -EIO;
+    }
+#endif
+
+  /* Suspended by the worker, wake up for the rest */
+
+  return bme280_activate(priv, true);
+}
+#endif
+
+/****************************************************************************
+ * Name: bme280_sim_ref_temp
+ *
+ * Description:
+ *   Reference compensation, as in the BME280 datasheet: the shifts are
+ *   applied to the dig_* values in every sample, like the kernels before
+ *   struct bme280_coeffs.  Kept to compare the speed and the results of
+ *   the kernels in compensate.h.
+ *
+ ****************************************************************************/
+
+static int32_t bme280_sim_ref_temp(FAR const struct bme280_calib *cal,
+                                   int32_t adc_temp, FAR int32_t *t_fine)
+{
+  int32_t var1;
+  int32_t var2;
+
+  var1 = (((adc_temp >> 3) - ((int32_t)cal->dig_t1 << 1)) *
+          ((int32_t)cal->dig_t2)) >> 11;
+  var2 = (((((adc_temp >> 4) - ((int32_t)cal->dig_t1)) *
+            ((adc_temp >> 4) - ((int32_t)cal->dig_t1))) >> 12) *
+          ((int32_t)cal->dig_t3)) >> 14;
+
+  *t_fine = var1 + var2;
+  return (*t_fine * 5 + 128) >> 8;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_ref_press
+ *
+ * Description:
+ *   Reference pressure compensation, as in the BME280 datasheet (Section
+ *   8.2 for CONFIG_BME280_PRESS_COMP_32BIT), in Q24.8 format.
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_ref_press(FAR const struct bme280_calib *cal,
+                                     int32_t t_fine, int32_t adc_press)
+{
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+  int32_t var1;
+  int32_t var2;
+  uint32_t p;
+
+  var1 = (t_fine >> 1) - (int32_t)64000;
+  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)cal->dig_p6);
+  var2 = var2 + ((var1 * ((int32_t)cal->dig_p5)) << 1);
+  var2 = (var2 >> 2) + (((int32_t)cal->dig_p4) << 16);
+  var1 = (((cal->dig_p3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+          ((((int32_t)cal->dig_p2) * var1) >> 1)) >> 18;
+  var1 = ((32768 + var1) * ((int32_t)cal->dig_p1)) >> 15;
+
+  if (var1 == 0)
+    {
+      return 0;
+    }
+
+  p = (((uint32_t)(((int32_t)1048576) - adc_press) - (var2 >> 12))) * 3125;
+  if (p < 0x80000000)
+    {
+      p = (p << 1) / ((uint32_t)var1);
+    }
+  else
+    {
+      p = (p / (uint32_t)var1) * 2;
+    }
+
+  var1 = (((int32_t)cal->dig_p9) *
+          ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+  var2 = (((int32_t)(p >> 2)) * ((int32_t)cal->dig_p8)) >> 13;
+  p = (uint32_t)((int32_t)p + ((var1 + var2 + cal->dig_p7) >> 4));
+
+  return p << 8;
+#else
+  int64_t var1;
+  int64_t var2;
+  int64_t p;
+
+  var1 = ((int64_t)t_fine) - 128000;
+  var2 = var1 * var1 * (int64_t)cal->dig_p6;
+  var2 = var2 + ((var1 * (int64_t)cal->dig_p5) << 17);
+  var2 = var2 + (((int64_t)cal->dig_p4) << 35);
+  var1 = ((var1 * var1 * (int64_t)cal->dig_p3) >> 8) +
+         ((var1 * (int64_t)cal->dig_p2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)cal->dig_p1) >> 33;
+
+  if (var1 == 0)
+    {
+      return 0;
+    }
+
+  p = 1048576 - adc_press;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)cal->dig_p9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)cal->dig_p8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((int64_t)cal->dig_p7) << 4);
+
+  return (uint32_t)p;
+#endif
+}
+
+/****************************************************************************
+ * Name: bme280_sim_ref_humidity
+ *
+ * Description:
+ *   Reference humidity compensation, as in the BME280 datasheet, in
+ *   Q22.10 format.
+ *
+ ****************************************************************************/
+
+static uint32_t bme280_sim_ref_humidity(FAR const struct bme280_calib *cal,
+                                        int32_t t_fine, int32_t adc_humi)
+{
+  int32_t h;
+
+  h = (t_fine - ((int32_t)76800));
+  h = ((((adc_humi << 14) - (((int32_t)cal->dig_h4) << 20) -
+         (((int32_t)cal->dig_h5) * h)) + ((int32_t)16384)) >> 15) *
+      (((((((h * ((int32_t)cal->dig_h6)) >> 10) *
+            (((h * ((int32_t)cal->dig_h3)) >> 11) + ((int32_t)32768))) >>
+           10) + ((int32_t)2097152)) * ((int32_t)cal->dig_h2) + 8192) >> 14);
+  h = (h - (((((h >> 15) * (h >> 15)) >> 7) *
+             ((int32_t)cal->dig_h1)) >> 4));
+  h = (h > 419430400 ? 419430400 : h);
+
+  return (uint32_t)(h >> 12);
+}
+
+/****************************************************************************
+ * Name: bme280_sim_bench_compensate
+ *
+ * Description:
+ *   Measure the compensation of a raw sample with the chip calibration,
+ *   first with a new temperature in every sample (t_fine recomputed),
+ *   then at a steady temperature (t_fine and its terms reused).  Then
+ *   measure the batch compensation of logged raw samples, which must give
+ *   the same values as one sample at a time, and the conversion to
+ *   published units.  The kernels of compensate.h are also timed against
+ *   the datasheet formulas on the dig_* values, which must give the same
+ *   results, and the sizes of the calibration blocks are logged.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_compensate(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct bme280_data *data = bench->priv->data;
+  FAR struct bme280_sim_batch_s *batch;
+  struct bme280_calib cal;
+#ifdef CONFIG_BME280_STATS
+  struct bme280_stats_s counters;
+#endif
+  struct sensor_baro baro;
+  struct sensor_humi humi;
+  volatile float sum = 0.0f;
+  struct timespec ts;
+  clock_t perf;
+  uint64_t ns[2];
+  int32_t adc_temp;
+  int32_t t_fine;
+  int32_t ref_fine;
+  uint32_t n;
+  int ret = OK;
+  int i;
+  int j;
+
+  syslog(LOG_INFO, "bme280 t_fine memo: %" PRIu32 " hits, %" PRIu32
+         " misses\n", data->memo_hits, data->memo_misses);
+
+  syslog(LOG_INFO, "bme280 sizes: struct bme280_data %zu bytes, "
+         "struct bme280_coeffs %zu bytes, struct bme280_calib %zu bytes\n",
+         sizeof(struct bme280_data), sizeof(struct bme280_coeffs),
+         sizeof(struct bme280_calib));
+
+  /* Time the datasheet formulas (j = 0) and the kernels (j = 1) on the
+   * same raw samples, with a new temperature in every sample
+   */
+
+  bme280_calib_parse(&cal, data->nvm);
+  for (j = 0; j < 2; j++)
+    {
+      perf = perf_gettime();
+      for (i = 0; i < BME280_SIM_CONVERSIONS; i++)
+        {
+          adc_temp = BME280_SIM_ADC_TEMP + (i & 63);
+          if (j == 0)
+            {
+              sum += bme280_sim_ref_temp(&cal, adc_temp, &t_fine);
+              sum += bme280_sim_ref_press(&cal, t_fine,
+                                          BME280_SIM_ADC_PRESS +
+                                          (i & 1023));
+              sum += bme280_sim_ref_humidity(&cal, t_fine,
+                                             BME280_SIM_ADC_HUMI +
+                                             (i & 255));
+            }
+          else
+            {
+              t_fine = bme280_comp_t_fine(&data->coeffs, adc_temp);
+              sum += bme280_comp_temp(t_fine);
+              sum += bme280_comp_press(&data->coeffs, t_fine,
+                                       BME280_SIM_ADC_PRESS + (i & 1023));
+              sum += bme280_comp_humidity(&data->coeffs, t_fine,
+                                          BME280_SIM_ADC_HUMI + (i & 255));
+            }
+        }
+
+      perf_convert(perf_gettime() - perf, &ts);
+      ns[j] = (1000000000ull * ts.tv_sec + ts.tv_nsec) /
+              BME280_SIM_CONVERSIONS;
+    }
+
+  syslog(LOG_INFO, "bme280 kernels: %" PRIu64 " ns per sample (datasheet "
+         "formulas), %" PRIu64 " ns (struct bme280_coeffs)\n",
+         ns[0], ns[1]);
+
+  for (i = 0; i < BME280_SIM_CONVERSIONS; i++)
+    {
+      adc_temp = BME280_SIM_ADC_TEMP + (i & 4095);
+      t_fine = bme280_comp_t_fine(&data->coeffs, adc_temp);
+      if (bme280_sim_ref_temp(&cal, adc_temp, &ref_fine) !=
+          bme280_comp_temp(t_fine) || ref_fine != t_fine ||
+          bme280_sim_ref_press(&cal, t_fine, BME280_SIM_ADC_PRESS + i) !=
+          bme280_comp_press(&data->coeffs, t_fine,
+                            BME280_SIM_ADC_PRESS + i) ||
+          bme280_sim_ref_humidity(&cal, t_fine,
+                                  BME280_SIM_ADC_HUMI + (i & 8191)) !=
+          bme280_comp_humidity(&data->coeffs, t_fine,
+                               BME280_SIM_ADC_HUMI + (i & 8191)))
+        {
+          snerr("Compensate: kernels differ from the datasheet at %d\n",
+                i);
+          return -EIO;
+        }
+    }
+
+  for (j = 0; j < 2; j++)
+    {
+      perf = perf_gettime();
+      for (i = 0; i < BME280_SIM_CONVERSIONS; i++)
+        {
+          bme280_compensate_temp(data,
+                                 BME280_SIM_ADC_TEMP + (j ? 0 : (i & 63)));
+          bme280_compensate_press(data,
+                                  BME280_SIM_ADC_PRESS + (i & 1023));
+          bme280_compensate_humidity(data,
+                                     BME280_SIM_ADC_HUMI + (i & 255));
+          sum += data->comp_press;
+        }
+
+      perf_convert(perf_gettime() - perf, &ts);
+      ns[j] = (1000000000ull * ts.tv_sec + ts.tv_nsec) /
+              BME280_SIM_CONVERSIONS;
+    }
+
+  syslog(LOG_INFO, "bme280 compensate: %" PRIu64 " ns per sample (new "
+         "temperature), %" PRIu64 " ns (same temperature)\n",
+         ns[0], ns[1]);
+
+  batch = (FAR struct bme280_sim_batch_s *)
+    kmm_malloc(sizeof(struct bme280_sim_batch_s));
+  if (batch == NULL)
+    {
+      return -ENOMEM;
+    }
+
+  for (i = 0; i < BME280_SIM_BATCH; i++)
+    {
+      batch->adc_temp[i]  = BME280_SIM_ADC_TEMP + (i & 63);
+      batch->adc_press[i] = BME280_SIM_ADC_PRESS + i;
+      batch->adc_humi[i]  = BME280_SIM_ADC_HUMI + (i & 255);
+    }
+
+  perf = perf_gettime();
+  for (i = 0; i < BME280_SIM_CONVERSIONS / BME280_SIM_BATCH; i++)
+    {
+      bme280_compensate_batch(&data->coeffs, batch->adc_temp,
+                              batch->adc_press, batch->adc_humi,
+                              batch->temp, batch->press, batch->humi,
+                              BME280_SIM_BATCH);
+      sum += batch->press[i % BME280_SIM_BATCH];
+    }
+
+  perf_convert(perf_gettime() - perf, &ts);
+  n = (uint32_t)(BME280_SIM_CONVERSIONS / BME280_SIM_BATCH *
+                 BME280_SIM_BATCH);
+  syslog(LOG_INFO, "bme280 compensate batch: %" PRIu64
+         " samples per second\n",
+         1000000000ull * n / (1000000000ull * ts.tv_sec + ts.tv_nsec + 1));
+
+  for (i = 0; i < BME280_SIM_BATCH; i++)
+    {
+      t_fine = bme280_comp_t_fine(&data->coeffs, batch->adc_temp[i]);
+      if (batch->temp[i] != bme280_comp_temp(t_fine) ||
+          batch->press[i] != bme280_comp_press(&data->coeffs, t_fine,
+                                               batch->adc_press[i]) ||
+          batch->humi[i] != bme280_comp_humidity(&data->coeffs, t_fine,
+                                                 batch->adc_humi[i]))
+        {
+          snerr("Compensate batch: sample %d differs\n", i);
+          ret = -EIO;
+          break;
+        }
+    }
+
+  kmm_free(batch);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  perf = perf_gettime();
+  for (i = 0; i < BME280_SIM_CONVERSIONS; i++)
+    {
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+      data->pressure += 1.0f;
+#else
+      data->comp_press++;
+#endif
+      bme280_convert(data, &baro, &humi);
+      sum += baro.pressure;
+    }
+
+  perf_convert(perf_gettime() - perf, &ts);
+  syslog(LOG_INFO, "bme280 convert: %" PRIu64 " ns per sample\n",
+         (1000000000ull * ts.tv_sec + ts.tv_nsec) / BME280_SIM_CONVERSIONS);
+
+#ifdef CONFIG_BME280_STATS
+  ret = bme280_sim_ioctl(bench->priv, SNIOC_BME280_GET_STATS,
+                         (unsigned long)&counters);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  syslog(LOG_INFO, "bme280 cache: %" PRIu32 " hits, %" PRIu32
+         " misses\n", counters.cache_hits, counters.cache_misses);
+#endif
+
+  /* The steady temperature of the fetches reuses t_fine */
+
+  if (data->memo_hits == 0)
+    {
+      snerr("Compensate: no t_fine memo hits\n");
+      return -EIO;
+    }
+
+  return OK;
+}
+
+#ifdef CONFIG_BME280_DUAL
+/****************************************************************************
+ * Name: bme280_sim_dual_merge
+ *
+ * Description:
+ *   Merge the completion times logged by the sensors at 0x76 and 0x77,
+ *   from the first completion of the sensor at 0x77.  Returns the number
+ *   of completion times in done.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_dual_merge(FAR struct bme280_sim_bus_s *bus,
+                                 FAR uint64_t *done)
+{
+  FAR struct bme280_sim_s *chip = bus->chip;
+  uint32_t next[2];
+  uint64_t t[2];
+  int n = 0;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      next[i] = chip[i].ndone > BME280_SIM_NDONE ?
+                chip[i].ndone - BME280_SIM_NDONE : 0;
+    }
+
+  while (next[0] < chip[0].ndone || next[1] < chip[1].ndone)
+    {
+      for (i = 0; i < 2; i++)
+        {
+          t[i] = next[i] < chip[i].ndone ?
+                 chip[i].done[next[i] % BME280_SIM_NDONE] : UINT64_MAX;
+        }
+
+      i = t[1] < t[0];
+      next[i]++;
+      if (n > 0 || i == 1)
+        {
+          done[n++] = t[i];
+        }
+    }
+
+  return n;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_bench_dual
+ *
+ * Description:
+ *   Register the sensors at 0x76 and 0x77 through bme280_register_dual,
+ *   and interleave them in Normal Mode at 1x for a merged interval of
+ *   50 ms for one second.  The simulated sensors run
+ *   at their typical measurement time, with different oscillator errors
+ *   and jitter, so the driver must track their phase.  The intervals
+ *   between the completions of the two sensors must be within
+ *   BME280_SIM_DUAL_TOLERANCE percent of their mean, except for
+ *   BME280_SIM_DUAL_OUTLIERS where the host woke the worker late, and the
+ *   mean within BME280_SIM_DUAL_TOLERANCE percent of the merged interval.
+ *   The samples in the ring must be timestamped within
+ *   BME280_SIM_DUAL_STAMP_US of a completion on average.  With
+ *   CONFIG_BME280_SCHEDULER, a bus cycle must skip the sensors in Dual
+ *   Mode.
+ *
+ ****************************************************************************/
+
+static int bme280_sim_bench_dual(FAR struct bme280_sim_bench_s *bench)
+{
+  FAR struct bme280_sim_bus_s *bus =
+    (FAR struct bme280_sim_bus_s *)bench->i2c;
+  FAR struct device *priv = bench->priv;
+  FAR struct device *priv2 = bench->priv2;
+  FAR struct device *dual;
+  struct bme280_sim_stats_s stats;
+  struct bme280_offset_s offset;
+#ifdef CONFIG_BME280_SCHEDULER
+  struct bme280_cycle_s cycle;
+#endif
+  uint64_t done[2 * BME280_SIM_NDONE];
+  unsigned long period;
+  uint64_t timestamp;
+  uint64_t stamp_sum = 0;
+  uint64_t stamp;
+  uint64_t mean;
+  uint64_t gap_min = UINT64_MAX;
+  uint64_t gap_max = 0;
+  uint64_t gap;
+  int outliers = 0;
+  int ndone;
+  int ret;
+  int i;
+  int j;
+
+  /* Put the sensors to sleep, and register them again in Dual Mode */
+
+  ret = bme280_activate(priv, false);
+  if (ret >= 0)
+    {
+      ret = bme280_activate(priv2, false);
+    }
+
+  if (ret >= 0)
+    {
+      ret = bme280_register_dual(BME280_SIM_DEVNO_DUAL, bench->i2c,
+                                 CONFIG_BME280_I2C_FREQUENCY);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  dual = bench->dual = g_bme280_registered;
+#ifdef CONFIG_BME280_PUSH_MODE
+  bench->pushed[0].size = sizeof(struct sensor_baro);
+  bench->pushed[1].size = sizeof(struct sensor_humi);
+  dual->sensor_baro.push_event = bme280_sim_push;
+  dual->sensor_baro.priv = &bench->pushed[0];
+  dual->sensor_humi.push_event = bme280_sim_push;
+  dual->sensor_humi.priv = &bench->pushed[1];
+#endif
+
+  if (ret >= 0)
+    {
+      ret = bme280_sim_ioctl(dual, SNIOC_BME280_SETCTRL,
+                             (unsigned long)&g_bme280_sim_normal);
+    }
+
+  period = 50000;
+  if (ret >= 0)
+    {
+      ret = bme280_set_interval(dual, &period);
+    }
+
+  bus->chip[0].ndone = 0;
+  bus->chip[1].ndone = 0;
+  if (ret >= 0)
+    {
+      ret = bme280_enable(dual, true);
+    }
+
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+  usleep(1000000);
+
+#ifdef CONFIG_BME280_SCHEDULER
+  /* The bus cycle must leave the sensors in Dual Mode to their worker */
+
+  ret = bme280_sample_bus(bench->i2c, &cycle);
+  if (ret < 0 || cycle.nsensors != 0)
+    {
+      snerr("Dual: bus cycle sampled %" PRIu32 " sensors: %d\n",
+            cycle.nsensors, ret);
+      bme280_enable(dual, false);
+      return -EIO;
+    }
+#endif
+
+  ret = bme280_enable(dual, false);
+  if (ret >= 0)
+    {
+      ret = bme280_sim_ioctl(dual, SNIOC_BME280_GET_OFFSET,
+                             (unsigned long)&offset);
+    }
+
+  ndone = bme280_sim_dual_merge(bus, done);
+  if (ret < 0 || dual->ring_count < 2 || ndone < 3)
+    {
+      return ret < 0 ? ret : -ETIMEDOUT;
+    }
+
+  bme280_sim_stats(bench->i2c, &stats, true);
+
+  /* Intervals between the completions of the two sensors */
+
+  mean = (done[ndone - 1] - done[0]) / (ndone - 1);
+  for (i = 1; i < ndone; i++)
+    {
+      gap = done[i] - done[i - 1];
+      gap_min = gap < gap_min ? gap : gap_min;
+      gap_max = gap > gap_max ? gap : gap_max;
+      if (100 * gap < (100 - BME280_SIM_DUAL_TOLERANCE) * mean ||
+          100 * gap > (100 + BME280_SIM_DUAL_TOLERANCE) * mean)
+        {
+          outliers++;
+        }
+    }
+
+  /* Error of the timestamps in the ring */
+
+  for (i = 0; i < dual->ring_count; i++)
+    {
+      timestamp = dual->ring_baro[(dual->ring_head +
+                                   CONFIG_BME280_RING_SIZE - i) %
+                                  CONFIG_BME280_RING_SIZE].timestamp;
+      stamp = UINT64_MAX;
+      for (j = 0; j < ndone; j++)
+        {
+          gap = timestamp > done[j] ? timestamp - done[j] :
+                                      done[j] - timestamp;
+          stamp = gap < stamp ? gap : stamp;
+        }
+
+      stamp_sum += stamp;
+    }
+
+  stamp = stamp_sum / dual->ring_count;
+  syslog(LOG_INFO, "bme280 dual: interval %lu us, %" PRIu32
+         " us per sensor, %" PRIu64 " us between %d samples (%" PRIu64
+         " to %" PRIu64 ", %d outliers), %" PRIu32 " resyncs, %" PRIu32
+         " transfers in 1 s\n", period, dual->period_us, mean, ndone,
+         gap_min, gap_max, outliers, dual->resyncs, stats.transfers);
+  syslog(LOG_INFO, "bme280 dual timestamps: %" PRIu64
+         " us off on average over the last %d samples\n", stamp,
+         dual->ring_count);
+  syslog(LOG_INFO, "bme280 dual offset: %f hPa, %f degC, %f %%RH after %"
+         PRIu32 " estimates\n", offset.pressure, offset.temperature,
+         offset.humidity, dual->noffset);
+
+  if (100 * mean < (100 - BME280_SIM_DUAL_TOLERANCE) * period ||
+      100 * mean > (100 + BME280_SIM_DUAL_TOLERANCE) * period ||
+      outliers > BME280_SIM_DUAL_OUTLIERS)
+    {
+      snerr("Dual: %" PRIu64 " to %" PRIu64 " us between samples, "
+            "interval %lu us\n", gap_min, gap_max, period);
+      return -EIO;
+    }
+
+  if (stamp > BME280_SIM_DUAL_STAMP_US)
+    {
+      snerr("Dual: timestamps off by %" PRIu64 " us\n", stamp);
+      return -EIO;
+    }
+
+  if (dual->noffset == 0)
+    {
+      snerr("Dual: no offset estimates\n");
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: bme280_sim_initialize
+ *
+ * Description:
+ *   Create a simulated I2C Bus with simulated BME280s at addresses 0x76
+ *   and 0x77
+ *
+ * Returned Value:
+ *   The simulated I2C Master on success; NULL on failure.
+ *
+ ****************************************************************************/
+
+FAR struct i2c_master_s *bme280_sim_initialize(void)
+{
+  FAR struct bme280_sim_bus_s *bus;
+  int i;
+
+  bus = (FAR struct bme280_sim_bus_s *)
+        kmm_zalloc(sizeof(struct bme280_sim_bus_s));
+  if (bus == NULL)
+    {
+      snerr("Failed to allocate simulator\n");
+      return NULL;
+    }
+
+  bus->dev.ops = &g_bme280_sim_ops;
+  bus->freq_max = BME280_SIM_FREQ_MAX;
+  for (i = 0; i < BME280_SIM_NCHIPS; i++)
+    {
+      bme280_sim_reset(&bus->chip[i]);
+      bus->chip[i].nvm_done = 0;
+    }
+
+  bus->chip[0].adc_bias = BME280_SIM_ADC_BIAS;
+  bus->chip[0].skew     = BME280_SIM_SKEW0;
+  bus->chip[1].skew     = BME280_SIM_SKEW1;
+  bus->chip[1].seed     = 1;
+
+#ifdef CONFIG_SPI
+  bus->spi.ops = &g_bme280_sim_spi_ops;
+  bme280_sim_reset(&bus->spi_chip);
+  bus->spi_chip.nvm_done = 0;
+#endif
+
+  return &bus->dev;
+}
+
+/****************************************************************************
+ * Name: bme280_sim_uninitialize
+ *
+ * Description:
+ *   Free the simulated I2C Bus
+ *
+ ****************************************************************************/
+
+void bme280_sim_uninitialize(FAR struct i2c_master_s *i2c)
+{
+  DEBUGASSERT(i2c != NULL);
+  kmm_free(i2c);
+}
+
+/****************************************************************************
+ * Name: bme280_sim_stats
+ *
+ * Description:
+ *   Get the bus statistics of the simulated I2C Bus
+ *
+ * Input Parameters:
+ *   i2c     - Simulated I2C Master from bme280_sim_initialize
+ *   stats   - Returned bus statistics
+ *   reset   - True to reset the statistics after reading
+ *
+ ****************************************************************************/
+
+void bme280_sim_stats(FAR struct i2c_master_s *i2c,
+                      FAR struct bme280_sim_stats_s *stats, bool reset)
+{
+  FAR struct bme280_sim_bus_s *bus = (FAR struct bme280_sim_bus_s *)i2c;
+
+  DEBUGASSERT(bus != NULL && stats != NULL);
+  memcpy(stats, &bus->stats, sizeof(*stats));
+  if (reset)
+    {
+      memset(&bus->stats, 0, sizeof(bus->stats));
+    }
+}
+
+#ifdef CONFIG_SPI
+/****************************************************************************
+ * Name: bme280_sim_spi
+ *
+ * Description:
+ *   Get the simulated SPI Bus of the simulator
+ *
+ ****************************************************************************/
+
+FAR struct spi_dev_s *bme280_sim_spi(FAR struct i2c_master_s *i2c)
+{
+  FAR struct bme280_sim_bus_s *bus = (FAR struct bme280_sim_bus_s *)i2c;
+
+  DEBUGASSERT(bus != NULL);
+  return &bus->spi;
+}
+#endif
+
+/****************************************************************************
+ * Name: bme280_sim_benchmark
+ *
+ * Description:
+ *   Run the driver against a simulated BME280 and report the I2C
+ *   transfers, bytes, bus time and wall time per bme280_fetch.  Each
+ *   iteration fetches the Barometer and the Humidity Sensor, like two
+ *   subscribers would.  Each step checks the behaviour it measures, and
+ *   the benchmark stops at the first step that fails.
+ *
+ * Input Parameters:
+ *   iterations - Number of iterations
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+int bme280_sim_benchmark(int iterations)
+{
+  FAR struct bme280_sim_bench_s *bench;
+  int ret;
+#ifdef CONFIG_SPI
+  int j;
+#endif
+
+  DEBUGASSERT(iterations > 0);
+
+  bench = (FAR struct bme280_sim_bench_s *)
+    kmm_zalloc(sizeof(struct bme280_sim_bench_s));
+  if (bench == NULL)
+    {
+      return -ENOMEM;
+    }
+
+  bench->i2c = bme280_sim_initialize();
+  if (bench->i2c == NULL)
+    {
+      kmm_free(bench);
+      return -ENOMEM;
+    }
+
+  bench->iterations = iterations;
+
+  ret = bme280_sim_bench_init(bench);
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_interval(bench);
+    }
+
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_resume(bench);
+    }
+
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_fetch(bench);
+    }
+
+#ifdef CONFIG_BME280_RECORD
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_record(bench);
+    }
+#endif
+
+#ifdef CONFIG_BME280_TRACE
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_trace(bench);
+    }
+#endif
+
+#ifdef CONFIG_BME280_STATS
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_stats(bench);
+    }
+#endif
+
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_forced(bench);
+    }
+
+#ifdef CONFIG_BME280_I2C_PROBE
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_probe(bench);
+    }
+#endif
+
+#ifdef CONFIG_SPI
+  /* Compare with the same fetches over SPI, in 4-wire and 3-wire mode */
+
+  for (j = 0; ret >= 0 && j < 2; j++)
+    {
+      ret = bme280_sim_bench_spi(bench, j == 1);
+    }
+#endif
+
+#ifdef CONFIG_BME280_SCHEDULER
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_scheduler(bench);
+    }
+#endif
+
+#ifdef CONFIG_BME280_WORKER
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_worker(bench);
+    }
+#endif
+
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_compensate(bench);
+    }
+
+#ifdef CONFIG_BME280_DUAL
+  if (ret >= 0)
+    {
+      ret = bme280_sim_bench_dual(bench);
+    }
+#endif
+
+  if (ret < 0)
+    {
+      snerr("Benchmark failed: %d\n", ret);
+    }
+
+#ifdef CONFIG_BME280_DUAL
+  if (bench->dual != NULL)
+    {
+      bme280_unregister_device(bench->dual, BME280_SIM_DEVNO_DUAL);
+    }
+#endif
+
+  if (bench->priv2 != NULL)
+    {
+      bme280_unregister_device(bench->priv2, BME280_SIM_DEVNO2);
+    }
+
+  if (bench->priv != NULL)
+    {
+      bme280_unregister_device(bench->priv, BME280_SIM_DEVNO);
+    }
+
+  bme280_sim_uninitialize(bench->i2c);
+  kmm_free(bench);
+  return ret;
+}
+
+#endif /* CONFIG_I2C && CONFIG_SENSORS_BME280 && CONFIG_SENSORS_BME280_SIM */
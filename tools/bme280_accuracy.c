@@ -0,0 +1,591 @@
+/****************************************************************************
+ * drivers/sensors/bme280/tools/bme280_accuracy.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Sweep the compensation of the driver (compensate.h) over the spread of
+ * the calibration of real parts (g_spread_min..g_spread_max): each
+ * parameter in turn, with the others at the datasheet example, then all
+ * of them at random.  Each set covers -40..85 degC, 300..1100 hPa and
+ * 0..100 %RH.  The pressure of the integer path is checked against the
+ * 64-bit integer formula of the BME280 Datasheet (Section 4.2.3), and the
+ * integer and floating-point paths against the double-precision formulas
+ * (Section 8.1), fed with the t_fine of each path.  Build with the same
+ * compensation options as the target.  Exits with a failure if an error
+ * exceeds the documented accuracy.
+ *
+ *   cc -O2 -o bme280_accuracy tools/bme280_accuracy.c
+ *   cc -O2 -DCONFIG_BME280_PRESS_COMP_32BIT -o bme280_accuracy ...
+ *   ./bme280_accuracy
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <float.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../compensate.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define ACCURACY_NPARAMS    18        /* Calibration parameters */
+#define ACCURACY_NSTEPS     9         /* Values of each across its spread */
+#define ACCURACY_NRANDOM    64        /* Sets with every parameter random */
+#define ACCURACY_NCALIB     (1 + ACCURACY_NPARAMS * ACCURACY_NSTEPS + \
+                             ACCURACY_NRANDOM)
+#define ACCURACY_SEED       5         /* Seed of the random sets */
+
+/* Raw ADC sweeps, wider than the environment to cover the whole range */
+
+#define ACCURACY_TEMP_MIN   400000
+#define ACCURACY_TEMP_MAX   620000
+#define ACCURACY_TEMP_STEP  1001
+#define ACCURACY_PRESS_MIN  200000
+#define ACCURACY_PRESS_MAX  650000
+#define ACCURACY_PRESS_STEP 997
+#define ACCURACY_HUM_MIN    0
+#define ACCURACY_HUM_MAX    65535
+#define ACCURACY_HUM_STEP   257
+
+/* Environment covered by the sweep */
+
+#define ACCURACY_DEGC_MIN   -40.0     /* degC */
+#define ACCURACY_DEGC_MAX   85.0
+#define ACCURACY_PA_MIN     30000     /* Pa */
+#define ACCURACY_PA_MAX     110000
+#define ACCURACY_RH_MIN     0.0       /* %RH, both excluded (clamped) */
+#define ACCURACY_RH_MAX     100.0
+
+/* Documented accuracy of the pressure path against the 64-bit formula.
+ * The 32-bit path has a resolution of 1 Pa, or 2 Pa when the dividend
+ * would overflow.  It adds the dig_P7..dig_P9 terms truncated to 1 Pa,
+ * and truncates its divisor twice, by up to 1 / 2^15 of it each
+ * (dig_P1 is above 2^15), or 3.4 Pa at 1100 hPa.  That is 9.7 Pa at most,
+ * and half of it on average.
+ */
+
+#define ACCURACY_LIMIT_PRESS_32BIT  (3.0 + 2.0 * ACCURACY_PA_MAX / 32768.0)
+
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+#  define ACCURACY_LIMIT_PRESS_MEAN (ACCURACY_LIMIT_PRESS_32BIT / 2.0)
+#  define ACCURACY_LIMIT_PRESS_MAX  ACCURACY_LIMIT_PRESS_32BIT
+#else
+#  define ACCURACY_LIMIT_PRESS_MEAN 0.0
+#  define ACCURACY_LIMIT_PRESS_MAX  0.0
+#endif
+
+/* Documented accuracy against the double-precision formulas, max only.
+ * The integer limits count LSBs of the published resolution.
+ */
+
+#define ACCURACY_LSB_TEMP   0.01              /* degC, comp_temp */
+#define ACCURACY_LSB_PRESS  (1.0 / 256.0)     /* Pa, Q24.8 */
+#define ACCURACY_LSB_HUM    (1.0 / 1024.0)    /* %RH, Q22.10 */
+
+/* Rounded to 0.01 degC (0.5 LSB), after adc_T >> 3 in the dig_T2 term
+ * (under 0.3 LSB at dig_T2 = 27500)
+ */
+
+#define ACCURACY_LIMIT_INT_TEMP     (1.0 * ACCURACY_LSB_TEMP)
+
+/* Truncated to Q24.8 (1 LSB), after p >> 13 is squared in the dig_P9
+ * term (under 1.5 LSB at dig_P9 = 7000 and 1100 hPa)
+ */
+
+#define ACCURACY_LIMIT_INT_PRESS    (3.0 * ACCURACY_LSB_PRESS)
+
+/* Truncated to Q22.10 (1 LSB), after the raw humidity is rounded to 2
+ * counts.  That is 1 count off at most, or 17 LSB at the steepest slope
+ * (dig_H2 = 420, dig_H3 = 255 and dig_H6 = 127 at 85 degC).
+ */
+
+#define ACCURACY_LIMIT_INT_HUMIDITY (18.0 * ACCURACY_LSB_HUM)
+
+/* Each float operation rounds by up to FLT_EPSILON / 2 of its result.
+ * The pressure formula chains 8 operations after its terms, and the
+ * offset cancels about half of the raw value.  Allow 8 FLT_EPSILON of
+ * the full scale on every path.
+ */
+
+#define ACCURACY_FLT_EPSILON        (8.0 * FLT_EPSILON)
+#define ACCURACY_LIMIT_FLT_TEMP     (ACCURACY_FLT_EPSILON * ACCURACY_DEGC_MAX)
+#define ACCURACY_LIMIT_FLT_PRESS    (ACCURACY_FLT_EPSILON * ACCURACY_PA_MAX)
+#define ACCURACY_LIMIT_FLT_HUMIDITY (ACCURACY_FLT_EPSILON * ACCURACY_RH_MAX)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Absolute error of one path against the reference */
+
+struct error_s
+{
+  double sum;                   /* Sum of the errors */
+  double bias;                  /* Sum of the signed errors */
+  double max;                   /* Largest error */
+  uint64_t count;               /* Number of samples */
+};
+
+/* Errors of all paths */
+
+struct accuracy_s
+{
+  struct error_s press;         /* Integer path vs 64-bit formula */
+  struct error_s int_temp;      /* Integer path vs double */
+  struct error_s int_press;
+  struct error_s int_humidity;
+  struct error_s flt_temp;      /* Float path vs double */
+  struct error_s flt_press;
+  struct error_s flt_humidity;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Calibration of the datasheet example (BMP280 Datasheet, Section 3.12) */
+
+static const struct bme280_calib g_example =
+{
+  27504, 26435, -1000,
+  36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+  75, 362, 0, 313, 50, 30
+};
+
+/* Spread of the calibration parameters across real parts, in the order
+ * of struct bme280_calib.  The ranges cover the datasheet examples and the
+ * values reported for BME280 parts, with a margin.  Most parameters are
+ * trimmed around a nominal value; dig_H1, dig_H3 and dig_H6 span their
+ * whole register.  The others are not swept over their whole register:
+ * the integer formulas of the datasheet overflow long before its ends
+ * (the 32-bit pressure from about |dig_P5| = 10000 or |dig_P6| = 7000,
+ * the humidity from about dig_H2 = 1000).
+ */
+
+static const struct bme280_calib g_spread_min =
+{
+  26000, 25000, -1000,
+  34000, -11500, 2500, 0, -500, -100, 9000, -16000, 3000,
+  0, 300, 0, 200, -100, -128
+};
+
+static const struct bme280_calib g_spread_max =
+{
+  30000, 27500, 1000,
+  40000, -9500, 3500, 10000, 500, 100, 16000, -9000, 7000,
+  255, 420, 255, 400, 100, 127
+};
+
+static uint32_t g_seed = ACCURACY_SEED;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: spread_value
+ *
+ * Description:
+ *   Return step of ACCURACY_NSTEPS evenly spaced values in min..max, or a
+ *   pseudo-random value in min..max (the same on every host) if step is
+ *   negative
+ *
+ ****************************************************************************/
+
+static int32_t spread_value(int32_t min, int32_t max, int step)
+{
+  if (step < 0)
+    {
+      g_seed = g_seed * 1103515245 + 12345;
+      return min + (int32_t)((g_seed >> 16) % (uint32_t)(max - min + 1));
+    }
+
+  return min + (max - min) * step / (ACCURACY_NSTEPS - 1);
+}
+
+/****************************************************************************
+ * Name: calib_spread
+ *
+ * Description:
+ *   Calibration set k of the sweep.  Set 0 is the datasheet example.  The
+ *   next ACCURACY_NPARAMS * ACCURACY_NSTEPS sets step one parameter across
+ *   its spread, with the others at the example.  The last
+ *   ACCURACY_NRANDOM sets draw every parameter at random from its spread.
+ *
+ ****************************************************************************/
+
+static void calib_spread(struct bme280_calib *cal, int k)
+{
+  int param = -1;
+  int step = -1;
+
+  *cal = g_example;
+  if (k == 0)
+    {
+      return;
+    }
+
+  if (k <= ACCURACY_NPARAMS * ACCURACY_NSTEPS)
+    {
+      param = (k - 1) / ACCURACY_NSTEPS;
+      step  = (k - 1) % ACCURACY_NSTEPS;
+    }
+
+#define SPREAD(i, f) \
+  if (param < 0 || param == (i)) \
+    { \
+      cal->f = spread_value(g_spread_min.f, g_spread_max.f, step); \
+    }
+
+  SPREAD(0, dig_t1);
+  SPREAD(1, dig_t2);
+  SPREAD(2, dig_t3);
+  SPREAD(3, dig_p1);
+  SPREAD(4, dig_p2);
+  SPREAD(5, dig_p3);
+  SPREAD(6, dig_p4);
+  SPREAD(7, dig_p5);
+  SPREAD(8, dig_p6);
+  SPREAD(9, dig_p7);
+  SPREAD(10, dig_p8);
+  SPREAD(11, dig_p9);
+  SPREAD(12, dig_h1);
+  SPREAD(13, dig_h2);
+  SPREAD(14, dig_h3);
+  SPREAD(15, dig_h4);
+  SPREAD(16, dig_h5);
+  SPREAD(17, dig_h6);
+
+#undef SPREAD
+}
+
+/****************************************************************************
+ * Name: ref_press
+ *
+ * Description:
+ *   Pressure in Pa as Q24.8, with the 64-bit integer formula of the BME280
+ *   Datasheet (Section 4.2.3), straight from the calibration parameters
+ *
+ ****************************************************************************/
+
+static uint32_t ref_press(const struct bme280_calib *cal, int32_t t_fine,
+                          int32_t adc_press)
+{
+  int64_t var1;
+  int64_t var2;
+  int64_t p;
+
+  var1 = (int64_t)t_fine - 128000;
+  var2 = var1 * var1 * (int64_t)cal->dig_p6;
+  var2 = var2 + ((var1 * (int64_t)cal->dig_p5) * 131072);
+  var2 = var2 + ((int64_t)cal->dig_p4 * 34359738368);
+  var1 = ((var1 * var1 * (int64_t)cal->dig_p3) >> 8) +
+         ((var1 * (int64_t)cal->dig_p2) * 4096);
+  var1 = (((int64_t)1 << 47) + var1) * (int64_t)cal->dig_p1 >> 33;
+  if (var1 == 0)
+    {
+      return 0;
+    }
+
+  p = 1048576 - adc_press;
+  p = ((p * 2147483648) - var2) * 3125 / var1;
+  var1 = ((int64_t)cal->dig_p9 * (p >> 13) * (p >> 13)) >> 25;
+  var2 = ((int64_t)cal->dig_p8 * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + ((int64_t)cal->dig_p7 * 16);
+  return (uint32_t)p;
+}
+
+/****************************************************************************
+ * Name: double_t_fine
+ *
+ * Description:
+ *   t_fine and the temperature in degC, with the double-precision formula
+ *   of the BME280 Datasheet (Section 8.1).  Like there, t_fine is
+ *   truncated to an integer for the pressure and humidity formulas.
+ *
+ ****************************************************************************/
+
+static int32_t double_t_fine(const struct bme280_calib *cal,
+                             int32_t adc_temp, double *temp)
+{
+  double var1;
+  double var2;
+
+  var1 = (adc_temp / 16384.0 - cal->dig_t1 / 1024.0) * cal->dig_t2;
+  var2 = (adc_temp / 131072.0 - cal->dig_t1 / 8192.0) *
+         (adc_temp / 131072.0 - cal->dig_t1 / 8192.0) * cal->dig_t3;
+  *temp = (var1 + var2) / 5120.0;
+  return (int32_t)(var1 + var2);
+}
+
+/****************************************************************************
+ * Name: double_press
+ *
+ * Description:
+ *   Pressure in Pa, with the double-precision formula of the BME280
+ *   Datasheet (Section 8.1)
+ *
+ ****************************************************************************/
+
+static double double_press(const struct bme280_calib *cal, double t_fine,
+                           int32_t adc_press)
+{
+  double var1;
+  double var2;
+  double p;
+
+  var1 = t_fine / 2.0 - 64000.0;
+  var2 = var1 * var1 * cal->dig_p6 / 32768.0;
+  var2 = var2 + var1 * cal->dig_p5 * 2.0;
+  var2 = var2 / 4.0 + cal->dig_p4 * 65536.0;
+  var1 = (cal->dig_p3 * var1 * var1 / 524288.0 + cal->dig_p2 * var1) /
+         524288.0;
+  var1 = (1.0 + var1 / 32768.0) * cal->dig_p1;
+  if (var1 == 0.0)
+    {
+      return 0.0;
+    }
+
+  p = 1048576.0 - adc_press;
+  p = (p - var2 / 4096.0) * 6250.0 / var1;
+  var1 = cal->dig_p9 * p * p / 2147483648.0;
+  var2 = p * cal->dig_p8 / 32768.0;
+  return p + (var1 + var2 + cal->dig_p7) / 16.0;
+}
+
+/****************************************************************************
+ * Name: double_humidity
+ *
+ * Description:
+ *   Humidity in %RH, with the double-precision formula of the BME280
+ *   Datasheet (Section 8.1)
+ *
+ ****************************************************************************/
+
+static double double_humidity(const struct bme280_calib *cal,
+                              double t_fine, int32_t adc_humidity)
+{
+  double h = t_fine - 76800.0;
+
+  h = (adc_humidity - (cal->dig_h4 * 64.0 + cal->dig_h5 / 16384.0 * h)) *
+      (cal->dig_h2 / 65536.0 *
+       (1.0 + cal->dig_h6 / 67108864.0 * h *
+        (1.0 + cal->dig_h3 / 67108864.0 * h)));
+  h = h * (1.0 - cal->dig_h1 * h / 524288.0);
+  return h < 0.0 ? 0.0 : (h > 100.0 ? 100.0 : h);
+}
+
+/****************************************************************************
+ * Name: error_add
+ ****************************************************************************/
+
+static void error_add(struct error_s *error, double value, double ref)
+{
+  double e = value > ref ? value - ref : ref - value;
+
+  error->sum  += e;
+  error->bias += value - ref;
+  error->max  = e > error->max ? e : error->max;
+  error->count++;
+}
+
+/****************************************************************************
+ * Name: error_check
+ *
+ * Description:
+ *   Print the bias (mean signed error), mean and max error of a path, and
+ *   check the mean and max against the limits.  A sweep without samples
+ *   fails too.
+ *
+ ****************************************************************************/
+
+static bool error_check(const char *name, const struct error_s *error,
+                        const char *unit, double mean_max, double max_max)
+{
+  double mean = error->count ? error->sum / error->count : 0.0;
+  double bias = error->count ? error->bias / error->count : 0.0;
+  bool ok = error->count > 0 && mean <= mean_max && error->max <= max_max;
+
+  printf("%s: bias %+.5f %s, mean %.5f %s (limit %.5f), "
+         "max %.5f %s (limit %.5f): %s\n", name, bias, unit, mean, unit,
+         mean_max, error->max, unit, max_max, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+/****************************************************************************
+ * Name: sweep_press
+ *
+ * Description:
+ *   Sweep the raw pressure at one raw temperature.  Each path gets its
+ *   own t_fine, and is checked against the double formula at that
+ *   t_fine: the temperature is checked on its own.
+ *
+ ****************************************************************************/
+
+static void sweep_press(const struct bme280_calib *cal,
+                        const struct bme280_coeffs *c,
+                        const struct bme280_fcoeffs *f, int32_t adc_temp,
+                        struct accuracy_s *acc)
+{
+  int32_t adc_press;
+  int32_t t_fine;
+  int32_t dt_fine;
+  float ft_fine;
+  double temp;
+  double ref;
+  uint32_t ref64;
+  uint32_t press;
+
+  t_fine  = bme280_comp_t_fine(c, adc_temp);
+  ft_fine = bme280_compf_t_fine(f, adc_temp);
+  dt_fine = double_t_fine(cal, adc_temp, &temp);
+
+  for (adc_press = ACCURACY_PRESS_MIN; adc_press <= ACCURACY_PRESS_MAX;
+       adc_press += ACCURACY_PRESS_STEP)
+    {
+      ref = double_press(cal, dt_fine, adc_press);
+      if (ref < ACCURACY_PA_MIN || ref > ACCURACY_PA_MAX)
+        {
+          continue;
+        }
+
+      ref64 = ref_press(cal, t_fine, adc_press);
+      press = bme280_comp_press(c, t_fine, adc_press);
+      error_add(&acc->press, press / 256.0, ref64 / 256.0);
+      error_add(&acc->int_press, press / 256.0,
+                double_press(cal, t_fine, adc_press));
+      error_add(&acc->flt_press,
+                bme280_compf_press(f, ft_fine, adc_press),
+                double_press(cal, ft_fine, adc_press));
+    }
+}
+
+/****************************************************************************
+ * Name: sweep_humidity
+ ****************************************************************************/
+
+static void sweep_humidity(const struct bme280_calib *cal,
+                           const struct bme280_coeffs *c,
+                           const struct bme280_fcoeffs *f, int32_t adc_temp,
+                           struct accuracy_s *acc)
+{
+  int32_t adc_humidity;
+  int32_t t_fine;
+  int32_t dt_fine;
+  float ft_fine;
+  double temp;
+  double ref;
+
+  t_fine  = bme280_comp_t_fine(c, adc_temp);
+  ft_fine = bme280_compf_t_fine(f, adc_temp);
+  dt_fine = double_t_fine(cal, adc_temp, &temp);
+
+  for (adc_humidity = ACCURACY_HUM_MIN; adc_humidity <= ACCURACY_HUM_MAX;
+       adc_humidity += ACCURACY_HUM_STEP)
+    {
+      ref = double_humidity(cal, dt_fine, adc_humidity);
+      if (ref <= ACCURACY_RH_MIN || ref >= ACCURACY_RH_MAX)
+        {
+          continue;
+        }
+
+      error_add(&acc->int_humidity,
+                bme280_comp_humidity(c, t_fine, adc_humidity) / 1024.0,
+                double_humidity(cal, t_fine, adc_humidity));
+      error_add(&acc->flt_humidity,
+                bme280_compf_humidity(f, ft_fine, adc_humidity),
+                double_humidity(cal, ft_fine, adc_humidity));
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(void)
+{
+  struct bme280_calib cal;
+  struct bme280_coeffs c;
+  struct bme280_fcoeffs f;
+  struct accuracy_s acc;
+  int32_t adc_temp;
+  double temp;
+  bool ok;
+  int k;
+
+  acc = (struct accuracy_s){ 0 };
+
+  for (k = 0; k < ACCURACY_NCALIB; k++)
+    {
+      calib_spread(&cal, k);
+      bme280_coeffs_init(&c, &cal);
+      bme280_fcoeffs_init(&f, &cal);
+      for (adc_temp = ACCURACY_TEMP_MIN; adc_temp <= ACCURACY_TEMP_MAX;
+           adc_temp += ACCURACY_TEMP_STEP)
+        {
+          double_t_fine(&cal, adc_temp, &temp);
+          if (temp < ACCURACY_DEGC_MIN || temp > ACCURACY_DEGC_MAX)
+            {
+              continue;
+            }
+
+          error_add(&acc.int_temp,
+                    bme280_temp_degc(bme280_comp_temp(
+                      bme280_comp_t_fine(&c, adc_temp))), temp);
+          error_add(&acc.flt_temp,
+                    bme280_compf_temp(bme280_compf_t_fine(&f, adc_temp)),
+                    temp);
+          sweep_press(&cal, &c, &f, adc_temp, &acc);
+          sweep_humidity(&cal, &c, &f, adc_temp, &acc);
+        }
+    }
+
+  printf("%d calibration sets: %" PRIu64 " temperature, %" PRIu64
+         " pressure and %" PRIu64 " humidity samples\n", ACCURACY_NCALIB,
+         acc.int_temp.count, acc.press.count, acc.int_humidity.count);
+#ifdef CONFIG_BME280_PRESS_COMP_32BIT
+  ok = error_check("32-bit pressure vs 64-bit", &acc.press, "Pa",
+                   ACCURACY_LIMIT_PRESS_MEAN, ACCURACY_LIMIT_PRESS_MAX);
+#else
+  ok = error_check("64-bit pressure vs datasheet", &acc.press, "Pa",
+                   ACCURACY_LIMIT_PRESS_MEAN, ACCURACY_LIMIT_PRESS_MAX);
+  ok &= error_check("integer pressure vs double", &acc.int_press, "Pa",
+                    ACCURACY_LIMIT_INT_PRESS, ACCURACY_LIMIT_INT_PRESS);
+#endif
+  ok &= error_check("integer temperature vs double", &acc.int_temp, "degC",
+                    ACCURACY_LIMIT_INT_TEMP, ACCURACY_LIMIT_INT_TEMP);
+  ok &= error_check("integer humidity vs double", &acc.int_humidity, "%RH",
+                    ACCURACY_LIMIT_INT_HUMIDITY,
+                    ACCURACY_LIMIT_INT_HUMIDITY);
+  ok &= error_check("float temperature vs double", &acc.flt_temp, "degC",
+                    ACCURACY_LIMIT_FLT_TEMP, ACCURACY_LIMIT_FLT_TEMP);
+  ok &= error_check("float pressure vs double", &acc.flt_press, "Pa",
+                    ACCURACY_LIMIT_FLT_PRESS, ACCURACY_LIMIT_FLT_PRESS);
+  ok &= error_check("float humidity vs double", &acc.flt_humidity, "%RH",
+                    ACCURACY_LIMIT_FLT_HUMIDITY,
+                    ACCURACY_LIMIT_FLT_HUMIDITY);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,393 @@
+/****************************************************************************
+ * drivers/sensors/bme280/tools/bme280_replay.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Replay a recording of the BME280 driver (SNIOC_BME280_GET_RECORD) on a
+ * host, through the compensation and conversion code of the driver
+ * (compensate.h).  Prints one line of CSV per frame, or with -b, the
+ * compensation throughput on the recorded frames.  Build with the same
+ * compensation options as the target:
+ *
+ *   cc -O2 -o bme280_replay tools/bme280_replay.c
+ *   cc -O2 -DCONFIG_BME280_PRESS_COMP_32BIT -o bme280_replay ...
+ *   cc -O2 -DCONFIG_BME280_FLOAT_COMPENSATION -o bme280_replay ...
+ *   ./bme280_replay [-b] recording.bin
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../compensate.h"
+#include "../record.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define REPLAY_CHIP_ID      0x60      /* BME280_CHIP_ID, with humidity */
+#define REPLAY_BENCH_MIN    10000000  /* Samples per benchmark run */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Recorded frames as raw ADC values */
+
+struct replay_s
+{
+  bool humidity;                /* True for BME280 */
+  size_t count;                 /* Number of frames */
+  uint64_t *us;                 /* Time since the first frame */
+  int32_t *adc_temp;
+  int32_t *adc_press;
+  int32_t *adc_humidity;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: load
+ *
+ * Description:
+ *   Read the header and the frames of a recording, and derive the
+ *   coefficients from the calibration NVM
+ *
+ ****************************************************************************/
+
+static int load(FILE *file, struct replay_s *replay,
+                struct bme280_calib *calib)
+{
+  uint8_t header[BME280_RECORD_HEADER_SIZE];
+  uint8_t frame[BME280_RECORD_FRAME_SIZE];
+  size_t capacity = 0;
+  uint32_t timestamp;
+  uint32_t last = 0;
+  uint64_t us = 0;
+
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      memcmp(header, BME280_RECORD_MAGIC, BME280_RECORD_MAGIC_SIZE) != 0)
+    {
+      fprintf(stderr, "Not a BME280 recording\n");
+      return -EINVAL;
+    }
+
+  memset(replay, 0, sizeof(*replay));
+  replay->humidity = header[BME280_RECORD_MAGIC_SIZE] == REPLAY_CHIP_ID;
+  bme280_calib_parse(calib, &header[BME280_RECORD_MAGIC_SIZE + 4]);
+
+  /* Timestamps wrap after 71 minutes, so add up the deltas */
+
+  while (fread(frame, sizeof(frame), 1, file) == 1)
+    {
+      if (replay->count == capacity)
+        {
+          capacity = capacity ? 2 * capacity : 1024;
+          replay->us = realloc(replay->us, capacity * sizeof(uint64_t));
+          replay->adc_temp = realloc(replay->adc_temp,
+                                     capacity * sizeof(int32_t));
+          replay->adc_press = realloc(replay->adc_press,
+                                      capacity * sizeof(int32_t));
+          replay->adc_humidity = realloc(replay->adc_humidity,
+                                         capacity * sizeof(int32_t));
+          if (replay->us == NULL || replay->adc_temp == NULL ||
+              replay->adc_press == NULL || replay->adc_humidity == NULL)
+            {
+              return -ENOMEM;
+            }
+        }
+
+      timestamp = (uint32_t)frame[0] | (uint32_t)frame[1] << 8 |
+                  (uint32_t)frame[2] << 16 | (uint32_t)frame[3] << 24;
+      us  += (replay->count == 0) ? 0 : timestamp - last;
+      last = timestamp;
+
+      replay->us[replay->count] = us;
+      bme280_raw_decode(&frame[4], &replay->adc_press[replay->count],
+                        &replay->adc_temp[replay->count],
+                        &replay->adc_humidity[replay->count]);
+      replay->count++;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: now_ns
+ ****************************************************************************/
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+#ifdef CONFIG_BME280_FLOAT_COMPENSATION
+/****************************************************************************
+ * Name: print_frames
+ *
+ * Description:
+ *   Compensate each frame with the floating-point formulas, and print
+ *   time, temperature, pressure and humidity as CSV
+ *
+ ****************************************************************************/
+
+static void print_frames(const struct replay_s *replay,
+                         const struct bme280_calib *calib)
+{
+  struct bme280_fcoeffs c;
+  float t_fine;
+  size_t i;
+
+  bme280_fcoeffs_init(&c, calib);
+  printf("time_us,temperature_degC,pressure_hPa,humidity_RH\n");
+  for (i = 0; i < replay->count; i++)
+    {
+      t_fine = bme280_compf_t_fine(&c, replay->adc_temp[i]);
+      printf("%" PRIu64 ",%.6f,%.6f", replay->us[i],
+             bme280_compf_temp(t_fine),
+             bme280_compf_press(&c, t_fine, replay->adc_press[i]) * 0.01f);
+      if (replay->humidity)
+        {
+          printf(",%.6f", bme280_compf_humidity(&c, t_fine,
+                                               replay->adc_humidity[i]));
+        }
+
+      printf("\n");
+    }
+}
+
+/****************************************************************************
+ * Name: benchmark
+ *
+ * Description:
+ *   Compensate the frames over and over, and print the samples per second
+ *
+ ****************************************************************************/
+
+static void benchmark(const struct replay_s *replay,
+                      const struct bme280_calib *calib)
+{
+  struct bme280_fcoeffs c;
+  volatile float sum = 0.0f;
+  uint64_t start;
+  uint64_t elapsed;
+  size_t runs = REPLAY_BENCH_MIN / replay->count + 1;
+  size_t r;
+  size_t i;
+  float t_fine;
+
+  bme280_fcoeffs_init(&c, calib);
+  start = now_ns();
+  for (r = 0; r < runs; r++)
+    {
+      for (i = 0; i < replay->count; i++)
+        {
+          t_fine = bme280_compf_t_fine(&c, replay->adc_temp[i]);
+          sum += bme280_compf_temp(t_fine) +
+                 bme280_compf_press(&c, t_fine, replay->adc_press[i]);
+          if (replay->humidity)
+            {
+              sum += bme280_compf_humidity(&c, t_fine,
+                                           replay->adc_humidity[i]);
+            }
+        }
+    }
+
+  elapsed = now_ns() - start;
+  printf("%zu frames, float: %.1f million samples per second\n",
+         replay->count, 1000.0 * runs * replay->count / elapsed);
+}
+#else
+/****************************************************************************
+ * Name: print_frames
+ *
+ * Description:
+ *   Compensate each frame, convert like the driver, and print time,
+ *   temperature, pressure and humidity as CSV
+ *
+ ****************************************************************************/
+
+static void print_frames(const struct replay_s *replay,
+                         const struct bme280_calib *calib)
+{
+  struct bme280_coeffs c;
+  int32_t t_fine;
+  size_t i;
+
+  bme280_coeffs_init(&c, calib);
+  printf("time_us,temperature_degC,pressure_hPa,humidity_RH\n");
+  for (i = 0; i < replay->count; i++)
+    {
+      t_fine = bme280_comp_t_fine(&c, replay->adc_temp[i]);
+      printf("%" PRIu64 ",%.6f,%.6f", replay->us[i],
+             bme280_temp_degc(bme280_comp_temp(t_fine)),
+             bme280_press_hpa(bme280_comp_press(&c, t_fine,
+                                                replay->adc_press[i])));
+      if (replay->humidity)
+        {
+          printf(",%.6f", bme280_humidity_rh(
+                   bme280_comp_humidity(&c, t_fine,
+                                        replay->adc_humidity[i])));
+        }
+
+      printf("\n");
+    }
+}
+
+/****************************************************************************
+ * Name: benchmark
+ *
+ * Description:
+ *   Compensate the frames over and over, one at a time and in batches, and
+ *   print the samples per second
+ *
+ ****************************************************************************/
+
+static void benchmark(const struct replay_s *replay,
+                      const struct bme280_calib *calib)
+{
+  struct bme280_coeffs c;
+  volatile uint32_t sum = 0;
+  int32_t *temp;
+  uint32_t *press;
+  uint32_t *humidity;
+  uint64_t start;
+  uint64_t single;
+  uint64_t batch;
+  size_t runs = REPLAY_BENCH_MIN / replay->count + 1;
+  size_t r;
+  size_t i;
+  int32_t t_fine;
+
+  bme280_coeffs_init(&c, calib);
+  temp = malloc(replay->count * sizeof(int32_t));
+  press = malloc(replay->count * sizeof(uint32_t));
+  humidity = malloc(replay->count * sizeof(uint32_t));
+  if (temp == NULL || press == NULL || humidity == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+  /* One sample at a time, like the driver */
+
+  start = now_ns();
+  for (r = 0; r < runs; r++)
+    {
+      for (i = 0; i < replay->count; i++)
+        {
+          t_fine = bme280_comp_t_fine(&c, replay->adc_temp[i]);
+          sum += bme280_comp_temp(t_fine) +
+                 bme280_comp_press(&c, t_fine, replay->adc_press[i]);
+          if (replay->humidity)
+            {
+              sum += bme280_comp_humidity(&c, t_fine,
+                                          replay->adc_humidity[i]);
+            }
+        }
+    }
+
+  single = now_ns() - start;
+
+  /* All frames in one batch */
+
+  start = now_ns();
+  for (r = 0; r < runs; r++)
+    {
+      bme280_compensate_batch(&c, replay->adc_temp, replay->adc_press,
+                              replay->humidity ? replay->adc_humidity :
+                              NULL, temp, press, humidity, replay->count);
+      sum += press[r % replay->count];
+    }
+
+  batch = now_ns() - start;
+  printf("%zu frames: %.1f million samples per second, %.1f million "
+         "in batches\n", replay->count,
+         1000.0 * runs * replay->count / single,
+         1000.0 * runs * replay->count / batch);
+
+  free(temp);
+  free(press);
+  free(humidity);
+}
+#endif /* CONFIG_BME280_FLOAT_COMPENSATION */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  struct bme280_calib calib;
+  struct replay_s replay;
+  bool bench = false;
+  FILE *file;
+  int ret;
+
+  if (argc == 3 && strcmp(argv[1], "-b") == 0)
+    {
+      bench = true;
+      argv++;
+      argc--;
+    }
+
+  if (argc != 2)
+    {
+      fprintf(stderr, "Usage: %s [-b] RECORDING\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  file = fopen(argv[1], "rb");
+  if (file == NULL)
+    {
+      fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+  ret = load(file, &replay, &calib);
+  fclose(file);
+  if (ret < 0)
+    {
+      return EXIT_FAILURE;
+    }
+
+  if (!bench)
+    {
+      print_frames(&replay, &calib);
+    }
+  else if (replay.count > 0)
+    {
+      benchmark(&replay, &calib);
+    }
+
+  return EXIT_SUCCESS;
+}
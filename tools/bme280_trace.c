@@ -0,0 +1,252 @@
+/****************************************************************************
+ * drivers/sensors/bme280/tools/bme280_trace.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Decode the binary trace of the BME280 driver on a host.  The input is
+ * the struct bme280_trace_s events returned by SNIOC_BME280_GET_TRACE,
+ * written to a file as is by a little-endian target.
+ *
+ *   cc -o bme280_trace tools/bme280_trace.c
+ *   ./bme280_trace trace.bin
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trace.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TRACE_RECORD_SIZE 8     /* Size of struct bme280_trace_s */
+#define TRACE_NEVENTS     (BME280_TRACE_ACTIVATE + 1)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const char *const g_event_names[TRACE_NEVENTS] =
+{
+  "?", "read", "write", "write", "fetch", "sample", "activate"
+};
+
+static const char *const g_sources[] =
+{
+  "sensor", "cache", "ring"
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sensors_name
+ *
+ * Description:
+ *   Return the names of the sensors of a fetch or activate event
+ *
+ ****************************************************************************/
+
+static const char *sensors_name(uint8_t sensors)
+{
+  switch (sensors)
+    {
+      case BME280_TRACE_BARO:
+        return "baro";
+
+      case BME280_TRACE_HUMI:
+        return "humi";
+
+      case BME280_TRACE_BARO | BME280_TRACE_HUMI:
+        return "baro+humi";
+
+      default:
+        return "none";
+    }
+}
+
+/****************************************************************************
+ * Name: decode
+ *
+ * Description:
+ *   Read one little-endian trace event from buf
+ *
+ ****************************************************************************/
+
+static void decode(const uint8_t *buf, struct bme280_trace_s *trace)
+{
+  trace->timestamp = (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+                     (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+  trace->event     = buf[4];
+  trace->reg       = buf[5];
+  trace->len       = buf[6];
+  trace->result    = (int8_t)buf[7];
+}
+
+/****************************************************************************
+ * Name: print_event
+ *
+ * Description:
+ *   Print one event at time us since the first event
+ *
+ ****************************************************************************/
+
+static void print_event(uint64_t us, uint32_t delta,
+                        const struct bme280_trace_s *trace)
+{
+  printf("%10" PRIu64 ".%03" PRIu64 " ms %9" PRIu32 " us  %-8s ",
+         us / 1000, us % 1000, delta,
+         trace->event < TRACE_NEVENTS ? g_event_names[trace->event] : "?");
+
+  switch (trace->event)
+    {
+      case BME280_TRACE_READ:
+        printf("0x%02x %3u bytes     ", trace->reg, trace->len);
+        break;
+
+      case BME280_TRACE_WRITE:
+        printf("0x%02x %3u byte      ", trace->reg, trace->len);
+        break;
+
+      case BME280_TRACE_WRITE_MULTI:
+        printf("0x%02x %3u pairs     ", trace->reg, trace->len);
+        break;
+
+      case BME280_TRACE_FETCH:
+        printf("%-9s from %-6s", sensors_name(trace->reg),
+               trace->len < 3 ? g_sources[trace->len] : "?");
+        break;
+
+      case BME280_TRACE_ACTIVATE:
+        printf("%-9s %-10s ", sensors_name(trace->reg),
+               trace->len ? "on" : "off");
+        break;
+
+      default:
+        printf("%20s", "");
+        break;
+    }
+
+  if (trace->result < 0)
+    {
+      printf(" %s\n", strerror(-trace->result));
+    }
+  else
+    {
+      printf(" ok\n");
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  struct bme280_trace_s trace;
+  uint8_t buf[TRACE_RECORD_SIZE];
+  uint32_t count[TRACE_NEVENTS];
+  uint32_t errors[TRACE_NEVENTS];
+  uint32_t last = 0;
+  uint32_t delta;
+  uint64_t us = 0;
+  uint64_t first_sample = 0;
+  uint64_t last_sample = 0;
+  uint32_t nevents = 0;
+  FILE *file;
+  int i;
+
+  if (argc != 2)
+    {
+      fprintf(stderr, "Usage: %s TRACE_FILE\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  file = fopen(argv[1], "rb");
+  if (file == NULL)
+    {
+      fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+  memset(count, 0, sizeof(count));
+  memset(errors, 0, sizeof(errors));
+
+  /* Timestamps wrap after 71 minutes, so add up the deltas */
+
+  while (fread(buf, sizeof(buf), 1, file) == 1)
+    {
+      decode(buf, &trace);
+      delta = (nevents == 0) ? 0 : trace.timestamp - last;
+      last  = trace.timestamp;
+      us   += delta;
+      nevents++;
+
+      print_event(us, delta, &trace);
+
+      i = (trace.event < TRACE_NEVENTS) ? trace.event : 0;
+      count[i]++;
+      if (trace.result < 0)
+        {
+          errors[i]++;
+        }
+
+      if (trace.event == BME280_TRACE_SAMPLE)
+        {
+          if (count[i] == 1)
+            {
+              first_sample = us;
+            }
+
+          last_sample = us;
+        }
+    }
+
+  fclose(file);
+
+  /* Summary per event */
+
+  printf("\n%" PRIu32 " events in %" PRIu64 " us\n", nevents, us);
+  for (i = 0; i < TRACE_NEVENTS; i++)
+    {
+      if (count[i] != 0)
+        {
+          printf("  %-12s %8" PRIu32 " events, %" PRIu32 " errors\n",
+                 i == BME280_TRACE_WRITE_MULTI ? "write_multi" :
+                 g_event_names[i], count[i], errors[i]);
+        }
+    }
+
+  if (count[BME280_TRACE_SAMPLE] > 1)
+    {
+      printf("  %" PRIu64 " us between samples\n",
+             (last_sample - first_sample) /
+             (count[BME280_TRACE_SAMPLE] - 1));
+    }
+
+  return EXIT_SUCCESS;
+}
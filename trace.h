@@ -0,0 +1,74 @@
+/****************************************************************************
+ * drivers/sensors/bme280/trace.h
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Binary trace events of the BME280 driver (CONFIG_BME280_TRACE).  Only
+ * <stdint.h> is needed, so the host decoder (tools/bme280_trace.c) shares
+ * this layout with the driver.
+ */
+
+#ifndef __DRIVERS_SENSORS_BME280_TRACE_H
+#define __DRIVERS_SENSORS_BME280_TRACE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Trace events */
+
+#define BME280_TRACE_READ        1  /* Register read: reg, len bytes */
+#define BME280_TRACE_WRITE       2  /* Register write: reg, 1 byte */
+#define BME280_TRACE_WRITE_MULTI 3  /* Register writes: reg, len pairs */
+#define BME280_TRACE_FETCH       4  /* Fetch: reg sensors, len source */
+#define BME280_TRACE_SAMPLE      5  /* New sample compensated and saved */
+#define BME280_TRACE_ACTIVATE    6  /* Activate: reg sensor, len enable */
+
+/* Sensors of BME280_TRACE_FETCH and BME280_TRACE_ACTIVATE */
+
+#define BME280_TRACE_BARO        0x01
+#define BME280_TRACE_HUMI        0x02
+
+/* Source of the sample of BME280_TRACE_FETCH */
+
+#define BME280_TRACE_FROM_SENSOR 0  /* Read from the sensor */
+#define BME280_TRACE_FROM_CACHE  1  /* Latest sample, still fresh */
+#define BME280_TRACE_FROM_RING   2  /* Newest sample of the worker */
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* One trace event, 8 bytes */
+
+struct bme280_trace_s
+{
+  uint32_t timestamp;           /* Time in microseconds, wraps in 71 min */
+  uint8_t event;                /* BME280_TRACE_* */
+  uint8_t reg;                  /* Register ID, or sensors */
+  uint8_t len;                  /* Bytes, pairs, source or enable */
+  int8_t result;                /* Zero, or a negated errno value */
+};
+
+#endif /* __DRIVERS_SENSORS_BME280_TRACE_H */